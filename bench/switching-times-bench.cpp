@@ -0,0 +1,347 @@
+/*
+ * Benchmark suite -> model RHS throughput, integration per horizon, tape recording (time and size), jacobian
+ * latency and full NLP::solve wall time, parameterized over n_s, dt, horizon and price-curve length
+ *
+ *     switching_times_bench [--format=json|csv] [--out=FILE] [--filter=SUBSTRING] [--min-time=SECONDS] [--quick]
+ *
+ * Every benchmark is repeated until --min-time seconds have passed (at least once) and reports the mean and the
+ * fastest iteration. Results are written as JSON (default) or CSV to stdout or --out.
+ *
+ * The steady family checks that eval_f + eval_grad_f do not touch the heap once warmed up -> with glibc malloc,
+ * calloc and realloc are counted (operator new, Eigen and CppAD's thread_alloc all end up there), elsewhere only
+ * operator new is. Builds with assertions also abort on Eigen heap use (EIGEN_RUNTIME_NO_MALLOC, defined for the
+ * whole build). The exit status is 1 if a steady case allocated -> run by ctest as steady_heap.
+ * Event-located steps and scenario mode are outside of the guarantee (see Plant::Workspace) and are not checked:
+ * the steady cases use the plain example plant.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../src/switching-times.hpp"
+
+using namespace SwitchingTimes;
+
+// Heap allocations -> see the steady family
+std::atomic<size_t> heap_allocations(0);
+#if defined(__GLIBC__)
+extern "C" {
+    void *__libc_malloc(size_t size);
+    void *__libc_calloc(size_t n, size_t size);
+    void *__libc_realloc(void *p, size_t size);
+    void *malloc(size_t size) noexcept { heap_allocations += 1; return __libc_malloc(size); }
+    void *calloc(size_t n, size_t size) noexcept { heap_allocations += 1; return __libc_calloc(n, size); }
+    void *realloc(void *p, size_t size) noexcept { heap_allocations += 1; return __libc_realloc(p, size); }
+}
+#else
+void *operator new(std::size_t size) {
+    heap_allocations += 1;
+    if (void *_out = std::malloc(size == 0 ? 1 : size)) { return _out; };
+    throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+#endif
+
+namespace {
+    struct Case {
+        int n_s;
+        double dt;
+        double horizon;
+        int prices;
+    };
+    struct Result {
+        std::string family;
+        Case params;
+        size_t iterations;
+        double mean_ns;
+        double min_ns;
+        std::map<std::string, double> counters;
+    };
+    struct Options {
+        std::string format = "json";
+        std::string out;
+        std::string filter;
+        double min_time = 0.5;
+        bool quick = false;
+    };
+
+    std::string case_name(const std::string &family, const Case &c) {
+        std::ostringstream _name;
+        _name << family << "/n_s:" << c.n_s << "/dt:" << c.dt << "/horizon:" << c.horizon << "/prices:" << c.prices;
+        return _name.str();
+    };
+    // Plant of ./py/cxx-2-py-example.ipynb on the given grid -> prices cover the horizon uniformly
+    NLP example_plant(const Case &c) {
+        NLP nlp;
+        vector<double> x0(4);
+        x0 << 1.12, 0.87, 0., 0.;
+        vector<double> p_const(12);
+        p_const << 0.00067, 36.9, 0.073, 0.1, 2., 0.3, 7.84, 0.5, 0., 1., 1., 1.;
+        vector<double> p_dynamic = vector<double>::Zero(2 * c.prices + 1);
+        for(int k = 0; k < c.prices; ++k) { p_dynamic(k) = 10. + 5. * std::sin(2. * M_PI * k / c.prices); };
+        for(int k = 0; k <= c.prices; ++k) { p_dynamic(c.prices + k) = k * c.horizon / c.prices; };
+        vector<double> on_bound(2), off_bound(2);
+        on_bound << 6., 60.;
+        off_bound << 20., 120.;
+        // Evenly spread schedule -> one ON period of 30% (within the ON bounds) per n_s-th of the horizon
+        double _period = c.horizon / c.n_s;
+        double _on = std::min(std::max(0.3 * _period, on_bound(0)), on_bound(1));
+        vector<double> p_opt(2 * c.n_s);
+        for(int k = 0; k < c.n_s; ++k) {
+            p_opt(k) = k * _period + 1.;
+            p_opt(c.n_s + k) = p_opt(k) + _on;
+        };
+        nlp.set_p_const(p_const);
+        nlp.set_p_dynamic(p_dynamic);
+        nlp.set_p_optimize(p_opt);
+        nlp.set_t0(0.);
+        nlp.set_tf(c.horizon);
+        nlp.set_dt(c.dt);
+        nlp.set_x0(x0);
+        nlp.set_lower_bound(vector<double>::Zero(2 * c.n_s));
+        nlp.set_upper_bound(vector<double>::Constant(2 * c.n_s, c.horizon));
+        nlp.set_on_bound(on_bound);
+        nlp.set_off_bound(off_bound);
+        return nlp;
+    };
+    // Repeat f until min_time seconds have passed -> (iterations, mean ns, min ns)
+    template <typename F>
+    Result measure(const std::string &family, const Case &c, const double min_time, F &&f) {
+        Result _out{family, c, 0, 0., INFINITY, {}};
+        double _total = 0.;
+        while (_out.iterations == 0 || _total < min_time * 1e9) {
+            auto _start = std::chrono::steady_clock::now();
+            f();
+            double _ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - _start).count();
+            _total += _ns;
+            _out.min_ns = std::min(_out.min_ns, _ns);
+            _out.iterations += 1;
+        };
+        _out.mean_ns = _total / _out.iterations;
+        return _out;
+    };
+
+    /*
+     * Benchmarks
+     */
+    const int rhs_calls = 1000;
+    Result bench_rhs(const Case &c, const Options &options) {
+        NLP nlp = example_plant(c);
+        Plant &plant = *nlp.plant;
+        PriceCurve<double> prices(plant._p_dynamic, plant._price_index);
+        vector<double> x(plant._x0), dxdt = vector<double>::Zero(plant._x0.size());
+        double _sink = 0.;
+        Result _out = measure("rhs", c, options.min_time, [&] {
+            for(int k = 0; k < rhs_calls; ++k) {
+                plant.model(x, dxdt, k * c.horizon / rhs_calls, prices, plant._p_opt, plant._p_const);
+                _sink += dxdt(2);
+            };
+        });
+        _out.counters["rhs_per_second"] = rhs_calls / (_out.mean_ns * 1e-9);
+        _out.counters["checksum"] = _sink / _out.iterations;
+        return _out;
+    };
+    Result bench_integrate(const Case &c, const Options &options) {
+        NLP nlp = example_plant(c);
+        Plant &plant = *nlp.plant;
+        double _cost = 0.;
+        Result _out = measure("integrate", c, options.min_time, [&] {
+            _cost = plant.integrate(plant._t0, plant._tf, plant._dt, plant._x0)(2);
+        });
+        _out.counters["steps"] = std::floor(c.horizon / c.dt + 1e-9);
+        _out.counters["electricity_cost"] = _cost;
+        return _out;
+    };
+    Result bench_tape(const Case &c, const Options &options) {
+        NLP nlp = example_plant(c);
+        Plant &plant = *nlp.plant;
+        Result _out = measure("tape", c, options.min_time, [&] {
+            plant.new_tape = true;
+            plant.record_tape(plant._p_opt);
+        });
+        _out.counters["size_var"] = plant.objective_tape.size_var();
+        _out.counters["size_op"] = plant.objective_tape.size_op();
+        _out.counters["size_dyn_par"] = plant.objective_tape.size_dyn_par();
+        return _out;
+    };
+    Result bench_jacobian(const Case &c, const Options &options) {
+        NLP nlp = example_plant(c);
+        Plant &plant = *nlp.plant;
+        plant.record_tape(plant._p_opt);
+        vector<double> _grad;
+        Result _out = measure("jacobian", c, options.min_time, [&] { _grad = plant.jacobian(plant._p_opt); });
+        _out.counters["gradient_norm"] = _grad.norm();
+        return _out;
+    };
+    // IPOPT callbacks of a steady-state iteration -> the first pair records the tape and sizes the workspace
+    Result bench_steady(const Case &c, const Options &options) {
+        NLP nlp = example_plant(c);
+        Plant &plant = *nlp.plant;
+        int n = plant._p_opt.size();
+        vector<double> x = plant._p_opt, grad = vector<double>::Zero(n);
+        double f = 0.;
+        plant.eval_f(n, x.data(), true, f);
+        plant.eval_grad_f(n, x.data(), true, grad.data());
+        size_t _allocations = 0;
+        Result _out = measure("steady", c, options.min_time, [&] {
+            size_t _before = heap_allocations.load();
+#ifdef EIGEN_RUNTIME_NO_MALLOC
+            Eigen::internal::set_is_malloc_allowed(false);
+#endif
+            plant.eval_f(n, x.data(), true, f);
+            plant.eval_grad_f(n, x.data(), true, grad.data());
+#ifdef EIGEN_RUNTIME_NO_MALLOC
+            Eigen::internal::set_is_malloc_allowed(true);
+#endif
+            _allocations += heap_allocations.load() - _before;
+        });
+        _out.counters["heap_allocations"] = (double) _allocations / _out.iterations;
+        _out.counters["objective"] = f;
+        return _out;
+    };
+    Result bench_solve(const Case &c, const Options &options) {
+        NLP nlp = example_plant(c);
+        Result _out = measure("solve", c, options.min_time, [&] {
+            // Fresh plant every iteration -> includes taping
+            nlp = example_plant(c);
+            nlp.set_journal_level(0);
+            nlp.solve();
+        });
+        _out.counters["objective"] = nlp.get_objective();
+        _out.counters["status"] = nlp.get_solve_status();
+        return _out;
+    };
+
+    /*
+     * Parameter grids -> schedules need room for their ON/OFF periods (at least 30 minutes per switch pair)
+     */
+    std::vector<Case> grid(const std::vector<int> &n_s, const std::vector<double> &dt,
+                           const std::vector<double> &horizon, const std::vector<int> &prices) {
+        std::vector<Case> _out;
+        for(int _n_s : n_s) {
+            for(double _dt : dt) {
+                for(double _horizon : horizon) {
+                    for(int _prices : prices) {
+                        if (_horizon / _n_s >= 30.) { _out.push_back(Case{_n_s, _dt, _horizon, _prices}); };
+                    };
+                };
+            };
+        };
+        return _out;
+    };
+
+    /*
+     * Output
+     */
+    const std::vector<std::string> csv_counters = {"rhs_per_second", "steps", "size_var", "size_op", "size_dyn_par",
+                                                   "gradient_norm", "objective", "status", "heap_allocations"};
+    void write_json(std::ostream &out, const std::vector<Result> &results) {
+        char _date[32];
+        std::time_t _now = std::time(nullptr);
+        std::strftime(_date, sizeof(_date), "%Y-%m-%dT%H:%M:%S", std::localtime(&_now));
+        out << "{\n  \"context\": {\"date\": \"" << _date << "\", \"max_threads\": " << max_threads() << "},\n";
+        out << "  \"benchmarks\": [\n";
+        for(size_t k = 0; k < results.size(); ++k) {
+            const Result &r = results[k];
+            out << "    {\"name\": \"" << case_name(r.family, r.params) << "\", \"family\": \"" << r.family << "\", "
+                << "\"n_s\": " << r.params.n_s << ", \"dt\": " << r.params.dt << ", \"horizon\": " << r.params.horizon
+                << ", \"prices\": " << r.params.prices << ", \"iterations\": " << r.iterations
+                << ", \"mean_ns\": " << r.mean_ns << ", \"min_ns\": " << r.min_ns << ", \"counters\": {";
+            size_t _count = 0;
+            for(const auto &_item : r.counters) {
+                out << (_count++ > 0 ? ", " : "") << "\"" << _item.first << "\": " << _item.second;
+            };
+            out << "}}" << (k + 1 < results.size() ? "," : "") << "\n";
+        };
+        out << "  ]\n}\n";
+    };
+    void write_csv(std::ostream &out, const std::vector<Result> &results) {
+        out << "name,family,n_s,dt,horizon,prices,iterations,mean_ns,min_ns";
+        for(const std::string &_counter : csv_counters) { out << "," << _counter; };
+        out << "\n";
+        for(const Result &r : results) {
+            out << case_name(r.family, r.params) << "," << r.family << "," << r.params.n_s << "," << r.params.dt << ","
+                << r.params.horizon << "," << r.params.prices << "," << r.iterations << "," << r.mean_ns << ","
+                << r.min_ns;
+            for(const std::string &_counter : csv_counters) {
+                out << ",";
+                auto _it = r.counters.find(_counter);
+                if (_it != r.counters.end()) { out << _it->second; };
+            };
+            out << "\n";
+        };
+    };
+    Options parse(int argc, char **argv) {
+        Options _out;
+        for(int k = 1; k < argc; ++k) {
+            std::string _arg = argv[k];
+            auto _value = [&] (const std::string &flag) { return _arg.substr(flag.size()); };
+            if (_arg.rfind("--format=", 0) == 0) { _out.format = _value("--format="); }
+            else if (_arg.rfind("--out=", 0) == 0) { _out.out = _value("--out="); }
+            else if (_arg.rfind("--filter=", 0) == 0) { _out.filter = _value("--filter="); }
+            else if (_arg.rfind("--min-time=", 0) == 0) { _out.min_time = std::stod(_value("--min-time=")); }
+            else if (_arg == "--quick") { _out.quick = true; }
+            else { throw std::invalid_argument("Unknown argument '" + _arg + "'"); };
+        };
+        if (_out.format != "json" && _out.format != "csv") {
+            throw std::invalid_argument("Unknown format '" + _out.format + "' -> use json or csv");
+        };
+        if (_out.quick) { _out.min_time = 0.; };
+        return _out;
+    };
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    try {
+        options = parse(argc, argv);
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 2;
+    };
+    typedef Result (*benchmark)(const Case &, const Options &);
+    std::vector<std::pair<benchmark, std::vector<Case>>> suite = {
+            {bench_rhs,       grid({2, 10, 20}, {0.2}, {1440.}, {48, 96, 288})},
+            {bench_integrate, grid({10}, {0.1, 0.2, 1.}, {360., 1440.}, {48})},
+            {bench_tape,      grid({2, 10, 20}, {0.2, 1.}, {360., 1440.}, {48})},
+            {bench_jacobian,  grid({2, 10, 20}, {0.2, 1.}, {360., 1440.}, {48})},
+            {bench_steady,    grid({2, 10}, {0.2}, {360., 1440.}, {48})},
+            {bench_solve,     grid({2, 5, 10}, {0.2}, {360., 1440.}, {48})}
+    };
+    const char *families[] = {"rhs", "integrate", "tape", "jacobian", "steady", "solve"};
+    std::vector<Result> results;
+    for(size_t k = 0; k < suite.size(); ++k) {
+        for(const Case &c : suite[k].second) {
+            if (!options.filter.empty() && case_name(families[k], c).find(options.filter) == std::string::npos) {
+                continue;
+            };
+            results.push_back(suite[k].first(c, options));
+            std::cerr << case_name(families[k], c) << ": " << results.back().mean_ns * 1e-6 << " ms" << std::endl;
+        };
+    };
+    std::ofstream _file;
+    if (!options.out.empty()) { _file.open(options.out); };
+    std::ostream &out = options.out.empty() ? std::cout : _file;
+    if (options.format == "json") { write_json(out, results); } else { write_csv(out, results); };
+    for(const Result &r : results) {
+        auto _it = r.counters.find("heap_allocations");
+        if (_it != r.counters.end() && _it->second > 0.) {
+            std::cerr << case_name(r.family, r.params) << ": " << _it->second << " heap allocations per iteration"
+                      << std::endl;
+            return 1;
+        };
+    };
+    return 0;
+}
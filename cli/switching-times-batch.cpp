@@ -0,0 +1,119 @@
+/*
+ * Native batch driver -> solve a file of problems (see spec-file.hpp) on a thread pool, no Python involved
+ *
+ *     switching_times_batch PROBLEMS [--out=FILE] [--threads=N] [--print-level=N]
+ *
+ * Results are written as JSON lines in the order of the problem file: name, statuses, objective, iterations,
+ * wall time and the optimal schedule, or the error of a problem that could not be solved.
+ *
+ * Exit status -> 0 if every problem was solved, 1 if some problem recorded an error, 2 on bad arguments, an
+ * unreadable problem file or an output file that cannot be written.
+ */
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../src/parallel.hpp"
+#include "../src/spec-file.hpp"
+#include "../src/switching-times.hpp"
+
+using namespace SwitchingTimes;
+
+namespace {
+    struct Options {
+        std::string problems;
+        std::string out;
+        size_t threads = max_threads();
+        int print_level = 0;
+    };
+    Options parse(int argc, char **argv) {
+        Options _out;
+        for(int k = 1; k < argc; ++k) {
+            std::string _arg = argv[k];
+            if (_arg.rfind("--out=", 0) == 0) { _out.out = _arg.substr(6); }
+            else if (_arg.rfind("--threads=", 0) == 0) { _out.threads = std::stoul(_arg.substr(10)); }
+            else if (_arg.rfind("--print-level=", 0) == 0) { _out.print_level = std::stoi(_arg.substr(14)); }
+            else if (_arg.rfind("--", 0) != 0 && _out.problems.empty()) { _out.problems = _arg; }
+            else { throw std::invalid_argument("Unknown argument '" + _arg + "'"); };
+        };
+        if (_out.problems.empty()) { throw std::invalid_argument("Missing problem file"); };
+        return _out;
+    };
+    std::string escape(const std::string &s) {
+        std::string _out;
+        for(char c : s) {
+            if (c == '"' || c == '\\') { _out += '\\'; _out += c; }
+            else if (c == '\n') { _out += "\\n"; }
+            else { _out += c; };
+        };
+        return _out;
+    };
+    // Solve one problem -> its JSON line (failed is set if it holds an error)
+    std::string solve(const Problem &problem, const int print_level, bool &failed) {
+        std::ostringstream _out;
+        _out.precision(17);
+        _out << "{\"name\": \"" << escape(problem.name) << "\"";
+        try {
+            NLP nlp;
+            nlp.configure(problem.spec);
+            nlp.set_solver(problem.solver);
+            nlp.set_continuation(problem.continuation);
+            nlp.set_print_level(print_level);
+            nlp.set_journal_level(0);
+            auto _start = std::chrono::steady_clock::now();
+            nlp.solve();
+            std::chrono::duration<double> _elapsed = std::chrono::steady_clock::now() - _start;
+            _out << ", \"init_status\": " << nlp.get_init_status() << ", \"solve_status\": " << nlp.get_solve_status()
+                 << ", \"objective\": " << nlp.get_objective() << ", \"iterations\": " << nlp.get_stats().iterations
+                 << ", \"seconds\": " << _elapsed.count() << ", \"p_optimize\": [";
+            const vector<double> &p_opt = nlp.get_p_optimize_ipopt();
+            for(int k = 0; k < p_opt.size(); ++k) { _out << (k > 0 ? ", " : "") << p_opt(k); };
+            _out << "]";
+        } catch (const std::exception &e) {
+            _out << ", \"error\": \"" << escape(e.what()) << "\"";
+            failed = true;
+        };
+        _out << "}";
+        return _out.str();
+    };
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    std::vector<Problem> problems;
+    try {
+        options = parse(argc, argv);
+        problems = read_problems(options.problems);
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 2;
+    };
+    // Open the output before solving -> a bad path fails without spending the solves
+    std::ofstream _file;
+    if (!options.out.empty()) {
+        _file.open(options.out);
+        if (!_file) {
+            std::cerr << "Cannot open '" << options.out << "' for writing" << std::endl;
+            return 2;
+        };
+    };
+    std::ostream &out = options.out.empty() ? std::cout : _file;
+    std::vector<std::string> results(problems.size());
+    std::vector<char> failed(problems.size(), 0);
+    parallel_for(problems.size(), options.threads, [&] (size_t k, size_t thread) {
+        bool _failed = false;
+        results[k] = solve(problems[k], options.print_level, _failed);
+        failed[k] = _failed;
+    });
+    for(const std::string &_line : results) { out << _line << "\n"; };
+    out.flush();
+    if (!out) {
+        std::cerr << "Failed to write the results" << std::endl;
+        return 2;
+    };
+    for(char _failed : failed) { if (_failed) { return 1; }; };
+    return 0;
+}
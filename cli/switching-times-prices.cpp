@@ -0,0 +1,42 @@
+/*
+ * CSV to price store converter (see price-store.hpp)
+ *
+ *     switching_times_prices CSV STORE [--time-column=N] [--price-column=N] [--time-scale=X] [--delimiter=C]
+ *
+ * One interval per row (start time, price), header rows are skipped. Times are multiplied by the time scale,
+ * e.g. 0.0166666666666667 for epoch seconds to the minutes used by the plants.
+ */
+
+#include <iostream>
+#include <string>
+#include "../src/price-store.hpp"
+
+using namespace SwitchingTimes;
+
+int main(int argc, char **argv) {
+    std::string csv, store;
+    int time_column = 0, price_column = 1;
+    double time_scale = 1.;
+    char delimiter = ',';
+    try {
+        for(int k = 1; k < argc; ++k) {
+            std::string _arg = argv[k];
+            if (_arg.rfind("--time-column=", 0) == 0) { time_column = std::stoi(_arg.substr(14)); }
+            else if (_arg.rfind("--price-column=", 0) == 0) { price_column = std::stoi(_arg.substr(15)); }
+            else if (_arg.rfind("--time-scale=", 0) == 0) { time_scale = std::stod(_arg.substr(13)); }
+            else if (_arg.rfind("--delimiter=", 0) == 0 && _arg.size() == 13) { delimiter = _arg[12]; }
+            else if (_arg.rfind("--", 0) != 0 && csv.empty()) { csv = _arg; }
+            else if (_arg.rfind("--", 0) != 0 && store.empty()) { store = _arg; }
+            else { throw std::invalid_argument("Unknown argument '" + _arg + "'"); };
+        };
+        if (store.empty()) { throw std::invalid_argument("Usage: switching_times_prices CSV STORE [options]"); };
+        PriceStore::convert_csv(csv, store, time_column, price_column, time_scale, delimiter);
+        PriceStore _store(store);
+        std::cout << _store.size() << " prices from " << _store.times()(0) << " to "
+                  << _store.times()(_store.size()) << std::endl;
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 2;
+    };
+    return 0;
+}
@@ -1,6 +1,19 @@
 #include <iostream>
 #include "src/switching-times.hpp"
+#include "src/switching-times-search.hpp"
+#include "src/switching-times-mpc.hpp"
+#include "src/switching-times-fleet.hpp"
+#include "src/price-store.hpp"
+#include "src/result-writer.hpp"
+#include "src/switching-times-backtest.hpp"
+#include "src/switching-times-dp.hpp"
+#include "src/switching-times-shooting.hpp"
+#include "src/switching-times-collocation.hpp"
 #include <pybind11/pybind11.h>
+#include <pybind11/eigen.h>
+#include <pybind11/stl.h>
+#include <pybind11/numpy.h>
+#include <pybind11/functional.h>
 
 namespace py = pybind11;
 
@@ -12,8 +25,94 @@ namespace py = pybind11;
  */
 
 PYBIND11_MODULE(switching_times, m) {
+    m.def("models", &SwitchingTimes::model_names, "Names of the registered plant models");
+    // Event tracing -> Chrome trace JSON (chrome://tracing, Perfetto), dump between solves
+    m.def("trace_start", [] () { SwitchingTimes::Tracer::instance().start(); });
+    m.def("trace_stop", [] () { SwitchingTimes::Tracer::instance().stop(); });
+    m.def("trace_clear", [] () { SwitchingTimes::Tracer::instance().clear(); });
+    m.def("trace_json", [] () { return SwitchingTimes::Tracer::instance().json(); });
+    m.def("trace_dump", [] (const std::string &path) { SwitchingTimes::Tracer::instance().dump(path); });
+    m.attr("trace_enabled") = (bool) SWITCHINGTIMES_TRACE;
+    py::class_<SwitchingTimes::LBFGSB>(m, "lbfgsb_options")
+        .def_readwrite("memory", &SwitchingTimes::LBFGSB::memory)
+        .def_readwrite("max_iter", &SwitchingTimes::LBFGSB::max_iter)
+        .def_readwrite("tol", &SwitchingTimes::LBFGSB::tol)
+        .def_readwrite("ftol", &SwitchingTimes::LBFGSB::ftol)
+        .def_readonly("iterations", &SwitchingTimes::LBFGSB::iterations)
+        .def_readonly("evaluations", &SwitchingTimes::LBFGSB::evaluations);
+    py::class_<SwitchingTimes::Spec>(m, "spec")
+        .def(py::init([] (py::kwargs kwargs) {
+            SwitchingTimes::Spec spec;
+            for(auto item : kwargs) {
+                std::string key = item.first.cast<std::string>();
+                if (key == "p_const") { spec.p_const = item.second.cast<SwitchingTimes::vector<double>>(); }
+                else if (key == "p_dynamic") { spec.p_dynamic = item.second.cast<SwitchingTimes::vector<double>>(); }
+                else if (key == "p_optimize") { spec.p_optimize = item.second.cast<SwitchingTimes::vector<double>>(); }
+                else if (key == "x0") { spec.x0 = item.second.cast<SwitchingTimes::vector<double>>(); }
+                else if (key == "t0") { spec.t0 = item.second.cast<double>(); }
+                else if (key == "tf") { spec.tf = item.second.cast<double>(); }
+                else if (key == "dt") { spec.dt = item.second.cast<double>(); }
+                else if (key == "lower_bound") { spec.lower_bound = item.second.cast<SwitchingTimes::vector<double>>(); }
+                else if (key == "upper_bound") { spec.upper_bound = item.second.cast<SwitchingTimes::vector<double>>(); }
+                else if (key == "on_bound") { spec.on_bound = item.second.cast<SwitchingTimes::vector<double>>(); }
+                else if (key == "off_bound") { spec.off_bound = item.second.cast<SwitchingTimes::vector<double>>(); }
+                else if (key == "model") { spec.model = item.second.cast<std::string>(); }
+                else { throw py::key_error("Unknown spec field '" + key + "'"); };
+            };
+            return spec;
+        }))
+        .def_readwrite("p_const", &SwitchingTimes::Spec::p_const)
+        .def_readwrite("p_dynamic", &SwitchingTimes::Spec::p_dynamic)
+        .def_readwrite("p_optimize", &SwitchingTimes::Spec::p_optimize)
+        .def_readwrite("x0", &SwitchingTimes::Spec::x0)
+        .def_readwrite("t0", &SwitchingTimes::Spec::t0)
+        .def_readwrite("tf", &SwitchingTimes::Spec::tf)
+        .def_readwrite("dt", &SwitchingTimes::Spec::dt)
+        .def_readwrite("lower_bound", &SwitchingTimes::Spec::lower_bound)
+        .def_readwrite("upper_bound", &SwitchingTimes::Spec::upper_bound)
+        .def_readwrite("on_bound", &SwitchingTimes::Spec::on_bound)
+        .def_readwrite("off_bound", &SwitchingTimes::Spec::off_bound)
+        .def_readwrite("model", &SwitchingTimes::Spec::model);
+    py::class_<SwitchingTimes::Progress>(m, "progress")
+        .def_readonly("iteration", &SwitchingTimes::Progress::iteration)
+        .def_readonly("objective", &SwitchingTimes::Progress::objective)
+        .def_readonly("inf_pr", &SwitchingTimes::Progress::inf_pr)
+        .def_readonly("inf_du", &SwitchingTimes::Progress::inf_du)
+        .def_readonly("elapsed", &SwitchingTimes::Progress::elapsed);
+    py::class_<SwitchingTimes::ContinuationStage>(m, "continuation_stage")
+        .def_readonly("factor", &SwitchingTimes::ContinuationStage::factor)
+        .def_readonly("iterations", &SwitchingTimes::ContinuationStage::iterations)
+        .def_readonly("objective", &SwitchingTimes::ContinuationStage::objective)
+        .def_readonly("status", &SwitchingTimes::ContinuationStage::status);
+    py::class_<SwitchingTimes::SolveStats>(m, "solve_stats")
+        .def_readonly("rhs_evaluations", &SwitchingTimes::SolveStats::rhs_evaluations)
+        .def_readonly("integration_steps", &SwitchingTimes::SolveStats::integration_steps)
+        .def_readonly("tape_recordings", &SwitchingTimes::SolveStats::tape_recordings)
+        .def_readonly("new_dynamic_calls", &SwitchingTimes::SolveStats::new_dynamic_calls)
+        .def_readonly("eval_f_calls", &SwitchingTimes::SolveStats::eval_f_calls)
+        .def_readonly("eval_grad_f_calls", &SwitchingTimes::SolveStats::eval_grad_f_calls)
+        .def_readonly("eval_g_calls", &SwitchingTimes::SolveStats::eval_g_calls)
+        .def_readonly("eval_jac_g_calls", &SwitchingTimes::SolveStats::eval_jac_g_calls)
+        .def_readonly("eval_h_calls", &SwitchingTimes::SolveStats::eval_h_calls)
+        .def_readonly("tape_size_var", &SwitchingTimes::SolveStats::tape_size_var)
+        .def_readonly("tape_size_op", &SwitchingTimes::SolveStats::tape_size_op)
+        .def_readonly("iterations", &SwitchingTimes::SolveStats::iterations)
+        .def_readonly("objective", &SwitchingTimes::SolveStats::objective)
+        .def_readonly("tape_seconds", &SwitchingTimes::SolveStats::tape_seconds)
+        .def_readonly("eval_f_seconds", &SwitchingTimes::SolveStats::eval_f_seconds)
+        .def_readonly("eval_grad_f_seconds", &SwitchingTimes::SolveStats::eval_grad_f_seconds)
+        .def_readonly("solve_seconds", &SwitchingTimes::SolveStats::solve_seconds);
+    m.attr("stats_enabled") = (bool) SWITCHINGTIMES_STATS;
+    // Vector getters return copies -> the setters, configure and deserialize may reallocate the plant's storage
     py::class_<SwitchingTimes::NLP>(m, "plant")
         .def(py::init<>())
+        .def(py::init([] (const std::string &model) {
+            SwitchingTimes::NLP nlp;
+            nlp.set_model(model);
+            return nlp;
+        }), py::arg("model"))
+        .def("set_model", &SwitchingTimes::NLP::set_model)
+        .def("get_model", &SwitchingTimes::NLP::get_model)
         .def("set_p_const", &SwitchingTimes::NLP::set_p_const)
         .def("get_p_const", &SwitchingTimes::NLP::get_p_const)
         .def("set_p_dynamic", &SwitchingTimes::NLP::set_p_dynamic)
@@ -27,6 +126,12 @@ PYBIND11_MODULE(switching_times, m) {
         .def("get_tf", &SwitchingTimes::NLP::get_tf)
         .def("set_dt", &SwitchingTimes::NLP::set_dt)
         .def("get_dt", &SwitchingTimes::NLP::get_dt)
+        .def("set_events", &SwitchingTimes::NLP::set_events)
+        .def("get_events", &SwitchingTimes::NLP::get_events)
+        .def("set_event_width", &SwitchingTimes::NLP::set_event_width)
+        .def("get_event_width", &SwitchingTimes::NLP::get_event_width)
+        .def("set_event_steps", &SwitchingTimes::NLP::set_event_steps)
+        .def("get_event_steps", &SwitchingTimes::NLP::get_event_steps)
         .def("set_lower_bound", &SwitchingTimes::NLP::set_lower_bound)
         .def("get_lower_bound", &SwitchingTimes::NLP::get_lower_bound)
         .def("set_upper_bound", &SwitchingTimes::NLP::set_upper_bound)
@@ -36,10 +141,250 @@ PYBIND11_MODULE(switching_times, m) {
         .def("set_off_bound", &SwitchingTimes::NLP::set_off_bound)
         .def("get_off_bound", &SwitchingTimes::NLP::get_off_bound)
         .def("set_x0", &SwitchingTimes::NLP::set_x0)
+        .def("configure", &SwitchingTimes::NLP::configure)
         .def("get_x0", &SwitchingTimes::NLP::get_x0)
         .def("get_init_status", &SwitchingTimes::NLP::get_init_status)
         .def("get_solve_status", &SwitchingTimes::NLP::get_solve_status)
-        .def("solve", &SwitchingTimes::NLP::solve);
+        .def("get_objective", &SwitchingTimes::NLP::get_objective)
+        .def("set_scenarios", &SwitchingTimes::NLP::set_scenarios)
+        .def("get_scenarios", &SwitchingTimes::NLP::get_scenarios)
+        .def("get_scenario_weights", &SwitchingTimes::NLP::get_scenario_weights)
+        .def("clear_scenarios", &SwitchingTimes::NLP::clear_scenarios)
+        .def("set_scenario_threads", &SwitchingTimes::NLP::set_scenario_threads)
+        .def("set_batch_threads", &SwitchingTimes::NLP::set_batch_threads)
+        .def("evaluate", &SwitchingTimes::NLP::evaluate,
+             py::call_guard<py::gil_scoped_release, SwitchingTimes::ComputeGuard>())
+        .def("gradient", &SwitchingTimes::NLP::gradient,
+             py::call_guard<py::gil_scoped_release, SwitchingTimes::ComputeGuard>())
+        .def("simulate", [] (SwitchingTimes::NLP &nlp, const SwitchingTimes::vector_ref<double> &p_opt,
+                             const SwitchingTimes::vector_ref<double> &t_grid, py::object out) {
+            // Fill a preallocated (len(t_grid), n_state) array if given -> must be usable without a conversion copy
+            if (!out.is_none() && !py::isinstance<py::array_t<double, py::array::c_style>>(out)) {
+                throw std::invalid_argument("out must be a C-contiguous float64 array of shape (len(t_grid), n_state)");
+            };
+            py::array_t<double, py::array::c_style> _out = out.is_none() ?
+                py::array_t<double, py::array::c_style>({(long) t_grid.size(), (long) nlp.n_state()}) :
+                out.cast<py::array_t<double, py::array::c_style>>();
+            if (_out.ndim() != 2 || _out.shape(0) != t_grid.size() || _out.shape(1) != (long) nlp.n_state()) {
+                throw std::invalid_argument("out must be a C-contiguous float64 array of shape (len(t_grid), n_state)");
+            };
+            double *_data = _out.mutable_data();
+            {
+                py::gil_scoped_release release;
+                SwitchingTimes::ComputeGuard guard;
+                nlp.simulate(p_opt, t_grid, _data);
+            }
+            return _out;
+        }, py::arg("p_optimize"), py::arg("t_grid"), py::arg("out") = py::none())
+        .def("simulate_batch", [] (SwitchingTimes::NLP &nlp, const SwitchingTimes::matrix_ref<double> &p_opts,
+                                   const SwitchingTimes::vector_ref<double> &t_grid) {
+            py::array_t<double, py::array::c_style> _out({(long) p_opts.rows(), (long) t_grid.size(), (long) nlp.n_state()});
+            double *_data = _out.mutable_data();
+            {
+                py::gil_scoped_release release;
+                SwitchingTimes::ComputeGuard guard;
+                nlp.simulate_batch(p_opts, t_grid, _data);
+            }
+            return _out;
+        }, py::arg("p_optimizes"), py::arg("t_grid"))
+        .def("set_solver", &SwitchingTimes::NLP::set_solver)
+        .def("get_solver", &SwitchingTimes::NLP::get_solver)
+        .def("set_continuation", &SwitchingTimes::NLP::set_continuation)
+        .def("get_continuation", &SwitchingTimes::NLP::get_continuation)
+        .def("get_continuation_stages", &SwitchingTimes::NLP::get_continuation_stages)
+        .def_readwrite("lbfgsb", &SwitchingTimes::NLP::lbfgsb)
+        .def("set_callback", &SwitchingTimes::NLP::set_callback)
+        .def("set_stall_tolerance", &SwitchingTimes::NLP::set_stall_tolerance,
+             py::arg("tol"), py::arg("iterations") = 5)
+        .def("set_print_level", &SwitchingTimes::NLP::set_print_level)
+        .def("set_journal_level", &SwitchingTimes::NLP::set_journal_level)
+        .def("get_journal", &SwitchingTimes::NLP::get_journal)
+        .def("get_stopped_early", &SwitchingTimes::NLP::get_stopped_early)
+        .def("get_stats", &SwitchingTimes::NLP::get_stats)
+        .def("get_z_L", &SwitchingTimes::NLP::get_z_L)
+        .def("get_z_U", &SwitchingTimes::NLP::get_z_U)
+        .def("get_lambda", &SwitchingTimes::NLP::get_lambda)
+        .def("serialize", [] (const SwitchingTimes::NLP &nlp, bool include_tape) {
+            return py::bytes(nlp.serialize(include_tape));
+        }, py::arg("include_tape") = true)
+        .def("deserialize", [] (SwitchingTimes::NLP &nlp, const py::bytes &buffer) {
+            nlp.deserialize(buffer);
+        })
+        .def_readwrite("pickle_tape", &SwitchingTimes::NLP::_pickle_tape)
+        .def(py::pickle(
+            [] (const SwitchingTimes::NLP &nlp) {
+                return py::make_tuple(py::bytes(nlp.serialize(nlp._pickle_tape)), nlp._pickle_tape);
+            },
+            [] (const py::tuple &state) {
+                SwitchingTimes::NLP nlp;
+                nlp.deserialize(state[0].cast<std::string>());
+                nlp._pickle_tape = state[1].cast<bool>();
+                return nlp;
+            }))
+        .def("solve", &SwitchingTimes::NLP::solve,
+             py::call_guard<py::gil_scoped_release, SwitchingTimes::ComputeGuard>());
+    py::class_<SwitchingTimes::SwitchSearch::Candidate>(m, "switch_candidate")
+        .def_readonly("n_s", &SwitchingTimes::SwitchSearch::Candidate::n_s)
+        .def_readonly("p_optimize", &SwitchingTimes::SwitchSearch::Candidate::p_opt)
+        .def_readonly("lower_bound", &SwitchingTimes::SwitchSearch::Candidate::lower_bound)
+        .def_readonly("upper_bound", &SwitchingTimes::SwitchSearch::Candidate::upper_bound)
+        .def_readonly("objective", &SwitchingTimes::SwitchSearch::Candidate::objective)
+        .def_readonly("status", &SwitchingTimes::SwitchSearch::Candidate::status)
+        .def_readonly("feasible", &SwitchingTimes::SwitchSearch::Candidate::feasible);
+    py::class_<SwitchingTimes::SwitchSearch>(m, "switch_search")
+        .def(py::init<SwitchingTimes::NLP &>(), py::keep_alive<1, 2>())
+        .def_readwrite("max_rounds", &SwitchingTimes::SwitchSearch::_max_rounds)
+        .def_readwrite("max_candidates", &SwitchingTimes::SwitchSearch::_max_candidates)
+        .def_readwrite("threads", &SwitchingTimes::SwitchSearch::_threads)
+        .def_readwrite("rel_tol", &SwitchingTimes::SwitchSearch::_rel_tol)
+        .def("run", &SwitchingTimes::SwitchSearch::run,
+             py::call_guard<py::gil_scoped_release, SwitchingTimes::ComputeGuard>())
+        .def("get_history", &SwitchingTimes::SwitchSearch::get_history);
+    py::class_<SwitchingTimes::DynamicProgram>(m, "dynamic_program")
+        .def(py::init<SwitchingTimes::NLP &>(), py::keep_alive<1, 2>())
+        .def_readwrite("slot", &SwitchingTimes::DynamicProgram::_slot)
+        .def_readwrite("substeps", &SwitchingTimes::DynamicProgram::_substeps)
+        .def_readwrite("threads", &SwitchingTimes::DynamicProgram::_threads)
+        .def_readonly("objective", &SwitchingTimes::DynamicProgram::_objective)
+        .def("run", &SwitchingTimes::DynamicProgram::run,
+             py::call_guard<py::gil_scoped_release, SwitchingTimes::ComputeGuard>())
+        .def("apply", &SwitchingTimes::DynamicProgram::apply,
+             py::call_guard<py::gil_scoped_release, SwitchingTimes::ComputeGuard>());
+    py::class_<SwitchingTimes::RecedingHorizon::Step>(m, "horizon_step")
+        .def_readonly("time", &SwitchingTimes::RecedingHorizon::Step::time)
+        .def_readonly("x0", &SwitchingTimes::RecedingHorizon::Step::x0)
+        .def_readonly("p_optimize", &SwitchingTimes::RecedingHorizon::Step::p_opt)
+        .def_readonly("objective", &SwitchingTimes::RecedingHorizon::Step::objective)
+        .def_readonly("status", &SwitchingTimes::RecedingHorizon::Step::status)
+        .def_readonly("seconds", &SwitchingTimes::RecedingHorizon::Step::seconds)
+        .def_readonly("retaped", &SwitchingTimes::RecedingHorizon::Step::retaped)
+        .def_readonly("applied", &SwitchingTimes::RecedingHorizon::Step::applied);
+    py::class_<SwitchingTimes::RecedingHorizon>(m, "receding_horizon")
+        .def(py::init<SwitchingTimes::NLP &, const SwitchingTimes::vector<double> &,
+                      const SwitchingTimes::vector<double> &, const double, const double>(),
+             py::arg("plant"), py::arg("prices"), py::arg("times"), py::arg("shift"), py::arg("time"),
+             py::keep_alive<1, 2>())
+        .def_readwrite("print_level", &SwitchingTimes::RecedingHorizon::_print_level)
+        .def("step", &SwitchingTimes::RecedingHorizon::step,
+             py::call_guard<py::gil_scoped_release, SwitchingTimes::ComputeGuard>())
+        .def("run", &SwitchingTimes::RecedingHorizon::run,
+             py::call_guard<py::gil_scoped_release, SwitchingTimes::ComputeGuard>())
+        .def("get_steps", &SwitchingTimes::RecedingHorizon::get_steps)
+        .def("get_x", &SwitchingTimes::RecedingHorizon::get_x)
+        .def("get_time", &SwitchingTimes::RecedingHorizon::get_time);
+    py::class_<SwitchingTimes::Fleet>(m, "fleet")
+        .def(py::init<>())
+        .def("add", &SwitchingTimes::Fleet::add)
+        .def("size", &SwitchingTimes::Fleet::size)
+        .def("set_p_dynamic", &SwitchingTimes::Fleet::set_p_dynamic)
+        .def("set_coupling", &SwitchingTimes::Fleet::set_coupling,
+             py::arg("times"), py::arg("weights"), py::arg("lower"), py::arg("upper"), py::arg("sharpness") = 1.)
+        .def("clear_coupling", &SwitchingTimes::Fleet::clear_coupling)
+        .def("set_threads", &SwitchingTimes::Fleet::set_threads)
+        .def("set_print_level", &SwitchingTimes::Fleet::set_print_level)
+        .def("get_p_optimize_ipopt", &SwitchingTimes::Fleet::get_p_optimize_ipopt)
+        .def("get_coupling", &SwitchingTimes::Fleet::get_coupling)
+        .def("get_objective", &SwitchingTimes::Fleet::get_objective)
+        .def("get_init_status", &SwitchingTimes::Fleet::get_init_status)
+        .def("get_solve_status", &SwitchingTimes::Fleet::get_solve_status)
+        .def("solve", &SwitchingTimes::Fleet::solve,
+             py::call_guard<py::gil_scoped_release, SwitchingTimes::ComputeGuard>());
+    py::class_<SwitchingTimes::Shooting>(m, "shooting")
+        .def(py::init<const SwitchingTimes::NLP &>(), py::keep_alive<1, 2>())
+        .def("set_segments", &SwitchingTimes::Shooting::set_segments)
+        .def("set_threads", &SwitchingTimes::Shooting::set_threads)
+        .def("set_print_level", &SwitchingTimes::Shooting::set_print_level)
+        .def("get_p_optimize_ipopt", &SwitchingTimes::Shooting::get_p_optimize_ipopt)
+        .def("get_states", &SwitchingTimes::Shooting::get_states)
+        .def("get_objective", &SwitchingTimes::Shooting::get_objective)
+        .def("get_init_status", &SwitchingTimes::Shooting::get_init_status)
+        .def("get_solve_status", &SwitchingTimes::Shooting::get_solve_status)
+        .def("solve", &SwitchingTimes::Shooting::solve,
+             py::call_guard<py::gil_scoped_release, SwitchingTimes::ComputeGuard>());
+    py::class_<SwitchingTimes::Collocation>(m, "collocation")
+        .def(py::init<const SwitchingTimes::NLP &>(), py::keep_alive<1, 2>())
+        .def("set_intervals", &SwitchingTimes::Collocation::set_intervals)
+        .def("set_print_level", &SwitchingTimes::Collocation::set_print_level)
+        .def("get_p_optimize_ipopt", &SwitchingTimes::Collocation::get_p_optimize_ipopt)
+        .def("get_states", &SwitchingTimes::Collocation::get_states)
+        .def("get_objective", &SwitchingTimes::Collocation::get_objective)
+        .def("get_init_status", &SwitchingTimes::Collocation::get_init_status)
+        .def("get_solve_status", &SwitchingTimes::Collocation::get_solve_status)
+        .def("get_intervals", &SwitchingTimes::Collocation::get_intervals)
+        .def("get_nnz_jacobian", &SwitchingTimes::Collocation::get_nnz_jacobian)
+        .def("get_nnz_hessian", &SwitchingTimes::Collocation::get_nnz_hessian)
+        .def("solve", &SwitchingTimes::Collocation::solve,
+             py::call_guard<py::gil_scoped_release, SwitchingTimes::ComputeGuard>());
+    // Memory-mapped price series -> prices/times are read-only views of the mapping
+    py::class_<SwitchingTimes::PriceStore>(m, "price_store")
+        .def(py::init<const std::string &>(), py::arg("path"))
+        .def_static("from_csv", [] (const std::string &csv, const std::string &path, const int time_column,
+                                    const int price_column, const double time_scale) {
+                        SwitchingTimes::PriceStore::convert_csv(csv, path, time_column, price_column, time_scale);
+                        return SwitchingTimes::PriceStore(path);
+                    }, py::arg("csv"), py::arg("path"), py::arg("time_column") = 0, py::arg("price_column") = 1,
+                    py::arg("time_scale") = 1.)
+        .def_static("write", &SwitchingTimes::PriceStore::write, py::arg("path"), py::arg("prices"), py::arg("times"))
+        .def("size", &SwitchingTimes::PriceStore::size)
+        .def("prices", &SwitchingTimes::PriceStore::prices, py::return_value_policy::reference_internal)
+        .def("times", &SwitchingTimes::PriceStore::times, py::return_value_policy::reference_internal)
+        .def("locate", &SwitchingTimes::PriceStore::locate)
+        .def("window", [] (const SwitchingTimes::PriceStore &store, const size_t first, const size_t n,
+                           const double origin) { return store.window(first, n, origin); },
+             py::arg("first"), py::arg("n"), py::arg("origin"));
+    // Streaming result file -> read back with ./py/result_reader.py
+    py::class_<SwitchingTimes::ResultWriter>(m, "result_writer")
+        .def(py::init<const std::string &, const size_t, const size_t, const size_t, const size_t>(),
+             py::arg("path"), py::arg("n_opt"), py::arg("n_traj") = 0, py::arg("chunk_rows") = 4096,
+             py::arg("queue_capacity") = 8)
+        .def("push", [] (SwitchingTimes::ResultWriter &writer, const uint64_t id, const double time,
+                         const SwitchingTimes::NLP &nlp, const double seconds,
+                         const SwitchingTimes::vector<double> &trajectory) {
+                 if ((size_t) trajectory.size() != writer.n_traj()) {
+                     throw std::invalid_argument("Expected " + std::to_string(writer.n_traj()) +
+                                                 " trajectory samples, got " + std::to_string(trajectory.size()));
+                 };
+                 writer.push(id, time, *nlp.plant, seconds, trajectory.size() > 0 ? trajectory.data() : nullptr);
+             }, py::arg("id"), py::arg("time"), py::arg("plant"), py::arg("seconds") = 0.,
+             py::arg("trajectory") = SwitchingTimes::vector<double>(), py::call_guard<py::gil_scoped_release>())
+        .def("flush", &SwitchingTimes::ResultWriter::flush, py::call_guard<py::gil_scoped_release>())
+        .def("close", &SwitchingTimes::ResultWriter::close, py::call_guard<py::gil_scoped_release>())
+        .def("rows", &SwitchingTimes::ResultWriter::rows);
+    py::class_<SwitchingTimes::Backtest::Day>(m, "backtest_day")
+        .def_readonly("time", &SwitchingTimes::Backtest::Day::time)
+        .def_readonly("x0", &SwitchingTimes::Backtest::Day::x0)
+        .def_readonly("p_optimize", &SwitchingTimes::Backtest::Day::p_opt)
+        .def_readonly("objective", &SwitchingTimes::Backtest::Day::objective)
+        .def_readonly("init_status", &SwitchingTimes::Backtest::Day::init_status)
+        .def_readonly("status", &SwitchingTimes::Backtest::Day::status)
+        .def_readonly("iterations", &SwitchingTimes::Backtest::Day::iterations)
+        .def_readonly("seconds", &SwitchingTimes::Backtest::Day::seconds)
+        .def_readonly("solves", &SwitchingTimes::Backtest::Day::solves);
+    py::class_<SwitchingTimes::Backtest::Report>(m, "backtest_report")
+        .def_readonly("final", &SwitchingTimes::Backtest::Report::final)
+        .def_readonly("days", &SwitchingTimes::Backtest::Report::days)
+        .def_readonly("solves", &SwitchingTimes::Backtest::Report::solves)
+        .def_readonly("seconds", &SwitchingTimes::Backtest::Report::seconds)
+        .def_readonly("days_per_second", &SwitchingTimes::Backtest::Report::days_per_second);
+    py::class_<SwitchingTimes::Backtest>(m, "backtest")
+        .def(py::init<SwitchingTimes::NLP &, const SwitchingTimes::PriceStore &, const double, const double,
+                      const size_t>(),
+             py::arg("plant"), py::arg("store"), py::arg("start"), py::arg("period"), py::arg("days"),
+             py::keep_alive<1, 2>(), py::keep_alive<1, 3>())
+        .def_readwrite("threads", &SwitchingTimes::Backtest::_threads)
+        .def_readwrite("speculative", &SwitchingTimes::Backtest::_speculative)
+        .def_readwrite("tol", &SwitchingTimes::Backtest::_tol)
+        .def_readwrite("carried", &SwitchingTimes::Backtest::_carried)
+        .def("set_writer", [] (SwitchingTimes::Backtest &backtest, SwitchingTimes::ResultWriter *writer) {
+                 backtest._writer = writer;
+             }, py::keep_alive<1, 2>())
+        .def("set_callback", [] (SwitchingTimes::Backtest &backtest,
+                                 const std::function<bool(const SwitchingTimes::Backtest::Report &)> &callback) {
+                 backtest._callback = callback;
+             })
+        .def("run", &SwitchingTimes::Backtest::run,
+             py::call_guard<py::gil_scoped_release, SwitchingTimes::ComputeGuard>())
+        .def("get_results", &SwitchingTimes::Backtest::get_results);
 };
 
 /*
@@ -0,0 +1,64 @@
+"""
+Benchmark of the native L-BFGS-B backend against IPOPT on the example of ./cxx-2-py-example.ipynb
+
+    python lbfgsb-vs-ipopt.py
+"""
+import time
+import numpy as np
+import switching_times as st
+
+
+def example_plant(n_s=10):
+    wwtp = st.plant()
+    x0 = np.array([1.12, 0.87, 0., 0.])
+    p_const = np.array([0.00067, 36.9, 0.073,
+                        0.1, 2., 0.3, 7.84,
+                        0.5, 0.,
+                        1.,
+                        1., 1.])
+    p_dynamic = np.zeros(48 + 49)
+    for k in range(0, 48):
+        p_dynamic[k] = 10.
+    for k in range(0, 49):
+        p_dynamic[48 + k] = k * 60.
+    t0 = 0.
+    tf = 6. * 60.
+    dt = 0.2
+    p_optimize = np.zeros(2 * n_s)
+    lower_bound = np.zeros(2 * n_s)
+    upper_bound = np.zeros(2 * n_s)
+    on_bound = np.array([6., 60.])
+    off_bound = np.array([20., 120.])
+    for k in range(0, 2 * n_s):
+        lower_bound[k], upper_bound[k] = t0, tf
+    p_optimize[n_s] = on_bound[0] + 1.
+    for k in range(1, n_s):
+        p_optimize[k] = p_optimize[n_s + k - 1] + off_bound[0] + 1.
+        p_optimize[n_s + k] = p_optimize[k] + on_bound[0] + 1.
+    wwtp.set_p_const(p_const)
+    wwtp.set_p_dynamic(p_dynamic)
+    wwtp.set_p_optimize(p_optimize)
+    wwtp.set_t0(t0)
+    wwtp.set_tf(tf)
+    wwtp.set_dt(dt)
+    wwtp.set_x0(x0)
+    wwtp.set_lower_bound(lower_bound)
+    wwtp.set_upper_bound(upper_bound)
+    wwtp.set_on_bound(on_bound)
+    wwtp.set_off_bound(off_bound)
+    return wwtp
+
+
+if __name__ == '__main__':
+    repeats = 5
+    for n_s in [2, 5, 10, 20]:
+        for solver in ['ipopt', 'lbfgsb']:
+            timings = []
+            for _ in range(repeats):
+                wwtp = example_plant(n_s)
+                wwtp.set_solver(solver)
+                start = time.perf_counter()
+                wwtp.solve()
+                timings.append(time.perf_counter() - start)
+            print('n_s = {:2d} | {:6s} | {:8.3f} s (best of {}) | objective = {:.6f} | status = {}'.format(
+                n_s, solver, min(timings), repeats, wwtp.get_objective(), wwtp.get_solve_status()))
@@ -0,0 +1,52 @@
+"""
+Reader of the streaming result files written by switching_times.result_writer (see ../src/result-writer.hpp)
+
+    from result_reader import read_results
+    results = read_results("backtest.bin")
+    results["objective"], results["p_optimize"]  # one row per pushed result
+
+Chunks are read until the end of the file; a chunk that is still being written is ignored.
+"""
+import struct
+import numpy as np
+
+MAGIC = 0x53525453
+VERSION = 2
+FILE_HEADER = struct.Struct("=IIII")
+CHUNK_HEADER = struct.Struct("=Q")
+
+
+def iter_chunks(path):
+    """Yield the chunks of a result file as dicts of NumPy arrays (views of the file buffer)."""
+    with open(path, "rb") as f:
+        buffer = f.read()
+    magic, version, n_opt, n_traj = FILE_HEADER.unpack_from(buffer, 0)
+    if magic != MAGIC or version != VERSION:
+        raise ValueError("Not a result file (or an incompatible version): %s" % path)
+    offset = FILE_HEADER.size
+    columns = [("id", np.uint64, 1), ("time", np.float64, 1), ("objective", np.float64, 1),
+               ("seconds", np.float64, 1), ("p_optimize", np.float64, n_opt), ("trajectory", np.float64, n_traj),
+               ("init_status", np.int32, 1), ("solve_status", np.int32, 1), ("iterations", np.int32, 1)]
+    while offset + CHUNK_HEADER.size <= len(buffer):
+        rows, = CHUNK_HEADER.unpack_from(buffer, offset)
+        size = sum(rows * width * np.dtype(dtype).itemsize for _, dtype, width in columns)
+        padding = -size % 8  # Chunks end on an 8-byte boundary
+        size += padding
+        if offset + CHUNK_HEADER.size + size > len(buffer):
+            break
+        offset += CHUNK_HEADER.size
+        chunk = {}
+        for name, dtype, width in columns:
+            values = np.frombuffer(buffer, dtype=dtype, count=rows * width, offset=offset)
+            chunk[name] = values.reshape(rows, width) if name in ("p_optimize", "trajectory") else values
+            offset += values.nbytes
+        offset += padding
+        yield chunk
+
+
+def read_results(path):
+    """All rows of a result file -> dict of NumPy arrays, p_optimize/trajectory as (rows, width) matrices."""
+    chunks = list(iter_chunks(path))
+    if not chunks:
+        return {}
+    return {name: np.concatenate([chunk[name] for chunk in chunks]) for name in chunks[0]}
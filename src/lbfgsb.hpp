@@ -0,0 +1,133 @@
+#ifndef SWITCHINGTIMES_LBFGSB_HPP
+#define SWITCHINGTIMES_LBFGSB_HPP
+
+#include <Eigen/Dense>
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <functional>
+#include <vector>
+
+namespace SwitchingTimes {
+    /*
+     * Projected limited-memory BFGS for simple bound constraints (L-BFGS-B style)
+     *
+     * Variables at a bound with the gradient pointing outwards are held fixed, the
+     * remaining (free) variables are updated with the two-loop recursion and a
+     * projected backtracking line search. Meant for small problems where the IPOPT
+     * interior-point machinery dominates the cost of a solve.
+     */
+    class LBFGSB {
+    public:
+        typedef Eigen::VectorXd dense;
+        typedef std::function<double(const dense &, dense &)> function; // Returns f(x) and fills gradient
+        typedef std::function<bool(int, double, double)> progress;      // (iteration, f, projected gradient) -> false stops
+        // Termination status -> numbering follows Ipopt::ApplicationReturnStatus
+        enum Status {
+            converged = 0,             // Solve_Succeeded
+            line_search_failed = 3,    // Search_Direction_Becomes_Too_Small
+            user_requested_stop = 5,   // User_Requested_Stop
+            max_iter_exceeded = -1     // Maximum_Iterations_Exceeded
+        };
+        // Solver settings
+        int memory = 10;          // Number of correction pairs
+        int max_iter = 500;       // Maximum number of iterations
+        double tol = 1e-4;        // Projected gradient tolerance (infinity norm)
+        double ftol = 1e-10;      // Relative objective decrease tolerance
+        double armijo = 1e-4;     // Sufficient decrease parameter
+        int max_backtrack = 40;   // Maximum number of step halvings
+        // Output
+        int iterations = 0;
+        int evaluations = 0;
+        double objective = 0.;
+
+        Status minimize(const function &fg, dense &x, const dense &lower, const dense &upper,
+                        const progress &iteration = nullptr) {
+            const int n = x.size();
+            dense g(n), x_new(n), g_new(n), d(n);
+            std::deque<dense> s_hist, y_hist;
+            std::deque<double> rho_hist;
+            project(x, lower, upper);
+            double f = fg(x, g);
+            evaluations = 1;
+            for(iterations = 0; iterations < max_iter; ++iterations) {
+                double _pg = projected_gradient_norm(x, g, lower, upper);
+                if (iteration && !iteration(iterations, f, _pg)) { objective = f; return user_requested_stop; };
+                if (_pg < tol) { objective = f; return converged; };
+                // Free variables -> not at a bound with the gradient pointing outwards
+                Eigen::Array<bool, Eigen::Dynamic, 1> free(n);
+                for(int k = 0; k < n; ++k) {
+                    free(k) = !((x(k) <= lower(k) && g(k) > 0.) || (x(k) >= upper(k) && g(k) < 0.));
+                };
+                // Two-loop recursion restricted to the free variables
+                d = -g;
+                for(int k = 0; k < n; ++k) { if (!free(k)) { d(k) = 0.; }; };
+                std::vector<double> alpha(s_hist.size());
+                for(int j = (int) s_hist.size() - 1; j >= 0; --j) {
+                    alpha[j] = rho_hist[j] * masked_dot(s_hist[j], d, free);
+                    for(int k = 0; k < n; ++k) { if (free(k)) { d(k) -= alpha[j] * y_hist[j](k); }; };
+                };
+                if (!s_hist.empty()) {
+                    const dense &s = s_hist.back();
+                    const dense &y = y_hist.back();
+                    d *= s.dot(y) / y.squaredNorm();
+                };
+                for(int j = 0; j < (int) s_hist.size(); ++j) {
+                    double beta = rho_hist[j] * masked_dot(y_hist[j], d, free);
+                    for(int k = 0; k < n; ++k) { if (free(k)) { d(k) += (alpha[j] - beta) * s_hist[j](k); }; };
+                };
+                // Fall back to steepest descent if the quasi-Newton direction is not a descent direction
+                if (d.dot(g) >= 0.) {
+                    d = -g;
+                    for(int k = 0; k < n; ++k) { if (!free(k)) { d(k) = 0.; }; };
+                    s_hist.clear(); y_hist.clear(); rho_hist.clear();
+                };
+                // Projected backtracking line search -> first step is kept short (no curvature information)
+                double step = s_hist.empty() ? 1. / std::max(1., d.lpNorm<Eigen::Infinity>()) : 1.;
+                double f_new = f;
+                bool accepted = false;
+                for(int b = 0; b < max_backtrack; ++b) {
+                    x_new = x + step * d;
+                    project(x_new, lower, upper);
+                    f_new = fg(x_new, g_new);
+                    evaluations += 1;
+                    if (f_new <= f + armijo * g.dot(x_new - x)) { accepted = true; break; };
+                    step *= 0.5;
+                };
+                if (!accepted) { objective = f; return line_search_failed; };
+                // Curvature pair update
+                dense s = x_new - x;
+                dense y = g_new - g;
+                double sy = s.dot(y);
+                if (sy > 1e-10 * y.squaredNorm()) {
+                    s_hist.push_back(s); y_hist.push_back(y); rho_hist.push_back(1. / sy);
+                    if ((int) s_hist.size() > memory) {
+                        s_hist.pop_front(); y_hist.pop_front(); rho_hist.pop_front();
+                    };
+                };
+                bool stalled = (f - f_new) <= ftol * std::max({std::abs(f), std::abs(f_new), 1.});
+                x = x_new; g = g_new; f = f_new;
+                if (stalled) { objective = f; return converged; };
+            };
+            objective = f;
+            return max_iter_exceeded;
+        };
+
+    private:
+        static void project(dense &x, const dense &lower, const dense &upper) {
+            x = x.cwiseMax(lower).cwiseMin(upper);
+        };
+        static double projected_gradient_norm(const dense &x, const dense &g, const dense &lower, const dense &upper) {
+            dense _tmp = x - g;
+            project(_tmp, lower, upper);
+            return (_tmp - x).lpNorm<Eigen::Infinity>();
+        };
+        static double masked_dot(const dense &a, const dense &b, const Eigen::Array<bool, Eigen::Dynamic, 1> &mask) {
+            double _out = 0.;
+            for(int k = 0; k < a.size(); ++k) { if (mask(k)) { _out += a(k) * b(k); }; };
+            return _out;
+        };
+    };
+}
+
+#endif //SWITCHINGTIMES_LBFGSB_HPP
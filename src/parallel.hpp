@@ -0,0 +1,186 @@
+#ifndef SWITCHINGTIMES_PARALLEL_HPP
+#define SWITCHINGTIMES_PARALLEL_HPP
+
+#include <cppad/cppad.hpp>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace SwitchingTimes {
+    /*
+     * Thread bookkeeping required by CppAD -> every thread that records or evaluates
+     * an AD tape must be identifiable by a number in [0, max_threads())
+     */
+    inline size_t &thread_number() {
+        thread_local size_t _number = 0;
+        return _number;
+    };
+    inline std::atomic<bool> &in_parallel_region() {
+        static std::atomic<bool> _flag(false);
+        return _flag;
+    };
+    inline bool cppad_in_parallel() { return in_parallel_region().load(); };
+    inline size_t cppad_thread_num() { return thread_number(); };
+    inline size_t max_threads() {
+        size_t _n = std::max<size_t>(1, std::thread::hardware_concurrency());
+        return std::min<size_t>(_n, CPPAD_MAX_NUM_THREADS);
+    };
+    /*
+     * Keep the blocks freed by CppAD in the per-thread pools of thread_alloc instead of returning them to the heap
+     * -> repeated sweeps of the same tape (and recordings of the same size) stop calling malloc after the first one.
+     * Must be called in sequential mode, it is a no-op after the first call.
+     */
+    inline void hold_memory() {
+        static std::once_flag _once;
+        std::call_once(_once, [] { CppAD::thread_alloc::hold_memory(true); });
+    };
+    // Must be called in sequential mode before any AD computations run in parallel
+    inline void parallel_setup() {
+        static std::once_flag _once;
+        std::call_once(_once, [] {
+            CppAD::thread_alloc::parallel_setup(max_threads(), cppad_in_parallel, cppad_thread_num);
+            CppAD::parallel_ad<double>();
+        });
+        hold_memory();
+    };
+    /*
+     * One computation at a time -> the thread that starts a region is CppAD thread 0 and uses slot 0 of the
+     * per-thread workspaces, so callers on different OS threads (e.g. Python threads that released the GIL) are
+     * serialized here. Recursive -> a guarded call may start regions. Take it only after releasing the GIL.
+     */
+    inline std::recursive_mutex &compute_mutex() {
+        static std::recursive_mutex _mutex;
+        return _mutex;
+    };
+    struct ComputeGuard {
+        std::lock_guard<std::recursive_mutex> _lock{compute_mutex()};
+    };
+    // True on pool workers and on the caller while it runs a region -> nested parallel_for runs inline
+    inline bool &inside_region() {
+        thread_local bool _inside = false;
+        return _inside;
+    };
+    /*
+     * Persistent worker pool -> worker k is CppAD thread k for its whole life (spawned on first use), so a region
+     * costs two condition-variable handshakes instead of creating threads, and thread-local state (trace buffers,
+     * thread_alloc pools) is set up once per worker. Regions are serialized by compute_mutex().
+     */
+    class ThreadPool {
+    public:
+        static ThreadPool &instance() {
+            static ThreadPool _pool;
+            return _pool;
+        };
+        ~ThreadPool() {
+            {
+                std::lock_guard<std::mutex> _lock(_mutex);
+                _stop = true;
+            }
+            _start.notify_all();
+            for(auto &_thread : _threads) { _thread.join(); };
+        };
+        // Caller takes part as thread 0, workers 1, ..., n_threads - 1, items are handed out dynamically
+        void run(size_t n_items, size_t n_threads, const std::function<void(size_t, size_t)> &f) {
+            while (_threads.size() + 1 < n_threads) {
+                size_t _id = _threads.size() + 1;
+                _threads.emplace_back([this, _id] { loop(_id); });
+            };
+            _f = &f;
+            _n_items = n_items;
+            _next = 0;
+            _error = nullptr;
+            {
+                std::lock_guard<std::mutex> _lock(_mutex);
+                _active = n_threads;
+                _busy = n_threads - 1;
+                _generation += 1;
+            }
+            _start.notify_all();
+            size_t _number = thread_number();
+            thread_number() = 0;
+            inside_region() = true;
+            work(0);
+            inside_region() = false;
+            thread_number() = _number;
+            {
+                std::unique_lock<std::mutex> _lock(_mutex);
+                _done.wait(_lock, [this] { return _busy == 0; });
+            }
+            _f = nullptr;
+            if (_error) { std::rethrow_exception(_error); };
+        };
+
+    private:
+        std::vector<std::thread> _threads;
+        std::mutex _mutex;
+        std::condition_variable _start, _done;
+        size_t _generation = 0, _active = 0, _busy = 0;
+        bool _stop = false;
+        // Current region
+        const std::function<void(size_t, size_t)> *_f = nullptr;
+        size_t _n_items = 0;
+        std::atomic<size_t> _next{0};
+        std::exception_ptr _error = nullptr;
+        std::mutex _error_mutex;
+
+        ThreadPool() = default;
+        void work(const size_t thread) {
+            try {
+                for(size_t k = _next++; k < _n_items; k = _next++) { (*_f)(k, thread); };
+            } catch (...) {
+                std::lock_guard<std::mutex> _lock(_error_mutex);
+                if (!_error) { _error = std::current_exception(); };
+                _next = _n_items;
+            };
+        };
+        void loop(const size_t id) {
+            thread_number() = id;
+            inside_region() = true;
+            size_t _seen = 0;
+            std::unique_lock<std::mutex> _lock(_mutex);
+            while (true) {
+                _start.wait(_lock, [&] { return _stop || _generation != _seen; });
+                if (_stop) { return; };
+                _seen = _generation;
+                if (id >= _active) { continue; };
+                _lock.unlock();
+                work(id);
+                _lock.lock();
+                if (--_busy == 0) { _done.notify_one(); };
+            };
+        };
+    };
+    /*
+     * Run f(item, thread) for item = 0, ..., n_items - 1 on up to n_threads threads of the pool
+     * ... the calling thread takes part as thread 0, items are handed out dynamically
+     */
+    inline void parallel_for(size_t n_items, size_t n_threads, const std::function<void(size_t, size_t)> &f) {
+        if (inside_region()) {
+            for(size_t k = 0; k < n_items; ++k) { f(k, thread_number()); };
+            return;
+        };
+        ComputeGuard _guard;
+        n_threads = std::max<size_t>(1, std::min({n_threads, n_items, max_threads()}));
+        if (n_threads == 1) {
+            for(size_t k = 0; k < n_items; ++k) { f(k, thread_number()); };
+            return;
+        };
+        parallel_setup();
+        in_parallel_region() = true;
+        try {
+            ThreadPool::instance().run(n_items, n_threads, f);
+        } catch (...) {
+            in_parallel_region() = false;
+            throw;
+        };
+        in_parallel_region() = false;
+    };
+}
+
+#endif //SWITCHINGTIMES_PARALLEL_HPP
@@ -0,0 +1,162 @@
+#ifndef SWITCHINGTIMES_PRICE_STORE_HPP
+#define SWITCHINGTIMES_PRICE_STORE_HPP
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "switching-times.hpp"
+
+namespace SwitchingTimes {
+    /*
+     * Memory-mapped store of a historical price series
+     *
+     * Layout (native endianness, columns 8-byte aligned):
+     *     Header | times (n + 1 interval boundaries, increasing) | prices (n)
+     * Opening a store maps the file read-only, prices() and times() are views of the mapped columns. window()
+     * writes a slice directly in the p_dynamic layout of Plant::model (prices; boundaries relative to an origin).
+     */
+    class PriceStore {
+    public:
+        struct Header {
+            uint32_t magic;
+            uint32_t version;
+            uint64_t n;             // Number of price intervals
+            uint64_t times_offset;  // Byte offsets of the columns
+            uint64_t prices_offset;
+        };
+        static const uint32_t magic = 0x52505453; // "STPR"
+        static const uint32_t version = 1;
+
+        PriceStore(const std::string &path) {
+            int _fd = ::open(path.c_str(), O_RDONLY);
+            if (_fd < 0) { throw std::runtime_error("Cannot open price store '" + path + "'"); };
+            struct stat _stat;
+            if (::fstat(_fd, &_stat) != 0 || _stat.st_size < (off_t) sizeof(Header)) {
+                ::close(_fd);
+                throw std::invalid_argument("Not a price store '" + path + "'");
+            };
+            _size = _stat.st_size;
+            _data = ::mmap(nullptr, _size, PROT_READ, MAP_SHARED, _fd, 0);
+            ::close(_fd);
+            if (_data == MAP_FAILED) { _data = nullptr; throw std::runtime_error("Cannot map price store '" + path + "'"); };
+            const Header &_header = header();
+            if (_header.magic != magic || _header.version != version || _header.n == 0 ||
+                !fits(_header.times_offset, _header.n, 1) || !fits(_header.prices_offset, _header.n, 0)) {
+                unmap();
+                throw std::invalid_argument("Not a price store (or an incompatible version) '" + path + "'");
+            };
+        };
+        PriceStore(const PriceStore &) = delete;
+        PriceStore &operator=(const PriceStore &) = delete;
+        PriceStore(PriceStore &&other) : _data(other._data), _size(other._size) { other._data = nullptr; };
+        ~PriceStore() { unmap(); };
+
+        const Header &header() const { return *static_cast<const Header *>(_data); };
+        size_t size() const { return header().n; };
+        Eigen::Map<const vector<double>> times() const {
+            return Eigen::Map<const vector<double>>(column(header().times_offset), size() + 1);
+        };
+        Eigen::Map<const vector<double>> prices() const {
+            return Eigen::Map<const vector<double>>(column(header().prices_offset), size());
+        };
+        // Interval containing t -> clamped to [0, n - 1]
+        size_t locate(const double t) const {
+            const double *_times = column(header().times_offset);
+            size_t _k = std::upper_bound(_times, _times + size() + 1, t) - _times;
+            return std::min(std::max<size_t>(_k, 1) - 1, size() - 1);
+        };
+        /*
+         * n intervals from first in the p_dynamic layout -> out must hold 2 * n + 1 values: (prices; boundaries - origin)
+         */
+        void window(const size_t first, const size_t n, const double origin, double *out) const {
+            if (first > size() || n > size() - first) { throw std::out_of_range("Price window beyond the end of the store"); };
+            std::memcpy(out, column(header().prices_offset) + first, sizeof(double) * n);
+            const double *_times = column(header().times_offset) + first;
+            for(size_t k = 0; k <= n; ++k) { out[n + k] = _times[k] - origin; };
+        };
+        vector<double> window(const size_t first, const size_t n, const double origin) const {
+            vector<double> _out(2 * n + 1);
+            window(first, n, origin, _out.data());
+            return _out;
+        };
+
+        // Write a store -> times holds the n + 1 interval boundaries of the n prices
+        static void write(const std::string &path, const vector_ref<double> &prices, const vector_ref<double> &times) {
+            if (times.size() != prices.size() + 1 || prices.size() == 0) {
+                throw std::invalid_argument("Expected one more price time than prices");
+            };
+            for(int k = 0; k < prices.size(); ++k) {
+                if (!(times(k + 1) > times(k))) { throw std::invalid_argument("Price times must be increasing"); };
+            };
+            Header _header{magic, version, (uint64_t) prices.size(), 0, 0};
+            _header.times_offset = align(sizeof(Header));
+            _header.prices_offset = align(_header.times_offset + sizeof(double) * times.size());
+            std::ofstream _file(path, std::ios::binary);
+            if (!_file) { throw std::runtime_error("Cannot create price store '" + path + "'"); };
+            std::string _padding(8, '\0');
+            _file.write(reinterpret_cast<const char *>(&_header), sizeof(Header));
+            _file.write(_padding.data(), _header.times_offset - sizeof(Header));
+            _file.write(reinterpret_cast<const char *>(times.data()), sizeof(double) * times.size());
+            _file.write(_padding.data(), _header.prices_offset - _header.times_offset - sizeof(double) * times.size());
+            _file.write(reinterpret_cast<const char *>(prices.data()), sizeof(double) * prices.size());
+            if (!_file) { throw std::runtime_error("Cannot write price store '" + path + "'"); };
+        };
+        /*
+         * CSV (one interval per row: start time, price) to store -> times are multiplied by time_scale (e.g. 1 / 60
+         * for seconds to minutes), the last interval gets the length of the one before it. Rows whose fields are
+         * not numbers (a header) are skipped.
+         */
+        static void convert_csv(const std::string &csv, const std::string &path, const int time_column = 0,
+                                const int price_column = 1, const double time_scale = 1., const char delimiter = ',') {
+            std::ifstream _file(csv);
+            if (!_file) { throw std::runtime_error("Cannot open CSV '" + csv + "'"); };
+            std::vector<double> _times, _prices;
+            std::string _line, _field;
+            while (std::getline(_file, _line)) {
+                std::vector<std::string> _fields;
+                std::istringstream _row(_line);
+                while (std::getline(_row, _field, delimiter)) { _fields.push_back(_field); };
+                if ((int) _fields.size() <= std::max(time_column, price_column)) { continue; };
+                char *_end_time, *_end_price;
+                double _time = std::strtod(_fields[time_column].c_str(), &_end_time);
+                double _price = std::strtod(_fields[price_column].c_str(), &_end_price);
+                if (_end_time == _fields[time_column].c_str() || _end_price == _fields[price_column].c_str()) { continue; };
+                _times.push_back(time_scale * _time);
+                _prices.push_back(_price);
+            };
+            if (_prices.size() < 2) { throw std::invalid_argument("Expected at least two prices in '" + csv + "'"); };
+            _times.push_back(2. * _times.back() - _times[_times.size() - 2]);
+            write(path, Eigen::Map<const vector<double>>(_prices.data(), _prices.size()),
+                  Eigen::Map<const vector<double>>(_times.data(), _times.size()));
+        };
+
+    private:
+        void *_data = nullptr;
+        size_t _size = 0;
+
+        const double *column(const uint64_t offset) const {
+            return reinterpret_cast<const double *>(static_cast<const char *>(_data) + offset);
+        };
+        // Room for n + extra aligned doubles at offset -> by division, so a corrupt header cannot overflow the check
+        bool fits(const uint64_t offset, const uint64_t n, const uint64_t extra) const {
+            if (offset % sizeof(double) != 0 || offset < sizeof(Header) || offset > _size) { return false; };
+            uint64_t _room = (_size - offset) / sizeof(double);
+            return n <= _room && extra <= _room - n;
+        };
+        void unmap() {
+            if (_data != nullptr) { ::munmap(_data, _size); _data = nullptr; };
+        };
+        static uint64_t align(const uint64_t offset) { return (offset + 7) / 8 * 8; };
+    };
+}
+
+#endif //SWITCHINGTIMES_PRICE_STORE_HPP
@@ -0,0 +1,221 @@
+#ifndef SWITCHINGTIMES_RESULT_WRITER_HPP
+#define SWITCHINGTIMES_RESULT_WRITER_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "switching-times.hpp"
+
+namespace SwitchingTimes {
+    /*
+     * Streaming columnar writer of solve results -> rows are pushed from any thread, a background thread writes them
+     *
+     * File (native endianness):
+     *     FileHeader | chunk | chunk | ...
+     *     chunk = ChunkHeader (rows) | id (u64) | time | objective | seconds (f64) | p_opt (rows x n_opt, f64) |
+     *             trajectory (rows x n_traj, f64) | init_status | solve_status | iterations (i32) | padding
+     * Matrices are row-major. The padding (4 zero bytes after an odd number of rows) ends every chunk on an 8-byte
+     * boundary, so all f64 columns are 8-byte aligned.
+     * Chunks are self-contained, so a file is readable up to the last complete chunk while a backtest is running.
+     * Rows collect in the current chunk, full chunks are queued for the writer thread. At most queue_capacity chunks
+     * are held in memory -> push() only waits when the disk falls that far behind.
+     */
+    class ResultWriter {
+    public:
+        struct FileHeader {
+            uint32_t magic;
+            uint32_t version;
+            uint32_t n_opt;   // Switch times per row
+            uint32_t n_traj;  // Trajectory samples per row (0 -> none)
+        };
+        struct ChunkHeader {
+            uint64_t rows;
+        };
+        struct Row {
+            uint64_t id;
+            double time;              // E.g. absolute start of the optimized window
+            double objective;
+            double seconds;
+            int32_t init_status;
+            int32_t solve_status;
+            int32_t iterations;
+            const double *p_opt;      // n_opt values
+            const double *trajectory; // n_traj values (ignored if n_traj = 0)
+        };
+        static const uint32_t magic = 0x53525453; // "STRS"
+        static const uint32_t version = 2;
+
+        ResultWriter(const std::string &path, const size_t n_opt, const size_t n_traj = 0,
+                     const size_t chunk_rows = 4096, const size_t queue_capacity = 8) :
+                _n_opt(n_opt), _n_traj(n_traj), _chunk_rows(std::max<size_t>(chunk_rows, 1)),
+                _queue_capacity(std::max<size_t>(queue_capacity, 1)), _file(path, std::ios::binary) {
+            if (!_file) { throw std::runtime_error("Cannot create result file '" + path + "'"); };
+            FileHeader _header{magic, version, (uint32_t) n_opt, (uint32_t) n_traj};
+            _file.write(reinterpret_cast<const char *>(&_header), sizeof(FileHeader));
+            _chunk.reserve(_chunk_rows, _n_opt, _n_traj);
+            _thread = std::thread([this] () { drain(); });
+        };
+        ResultWriter(const ResultWriter &) = delete;
+        ResultWriter &operator=(const ResultWriter &) = delete;
+        ~ResultWriter() {
+            try { close(); } catch (...) {};
+        };
+
+        void push(const Row &row) {
+            std::unique_lock<std::mutex> _lock(_mutex);
+            if (_closed) { throw std::logic_error("Result writer is closed"); };
+            if (_error) { std::rethrow_exception(_error); };
+            if (_n_traj > 0 && row.trajectory == nullptr) { throw std::invalid_argument("Missing trajectory samples"); };
+            _chunk.append(row, _n_opt, _n_traj);
+            if (_chunk.size() == _chunk_rows) { enqueue(_lock); };
+        };
+        // Row from a solved plant -> trajectory must hold n_traj values (or be nullptr if n_traj = 0)
+        void push(const uint64_t id, const double time, const Plant &plant, const double seconds,
+                  const double *trajectory = nullptr) {
+            if ((size_t) plant._p_opt_ipopt.size() != _n_opt) {
+                throw std::invalid_argument("Expected " + std::to_string(_n_opt) + " switch times per row");
+            };
+            push(Row{id, time, plant._objective, seconds, plant._status_init, plant._status_solve, plant._iterations,
+                     plant._p_opt_ipopt.data(), trajectory});
+        };
+        // Write the rows pushed so far -> returns when they are on disk
+        void flush() {
+            std::unique_lock<std::mutex> _lock(_mutex);
+            if (_chunk.size() > 0) { enqueue(_lock); };
+            _drained.wait(_lock, [this] () { return (_queue.empty() && !_writing) || _error; });
+            if (_error) { std::rethrow_exception(_error); };
+        };
+        void close() {
+            {
+                std::unique_lock<std::mutex> _lock(_mutex);
+                if (_closed) { return; };
+                // A failed write is rethrown below, after the writer thread has been joined
+                try { if (_chunk.size() > 0) { enqueue(_lock); }; } catch (...) {};
+                _closed = true;
+            };
+            _ready.notify_all();
+            if (_thread.joinable()) { _thread.join(); };
+            _file.close();
+            if (_error) { std::rethrow_exception(_error); };
+        };
+        size_t rows() const {
+            std::lock_guard<std::mutex> _lock(_mutex);
+            return _rows;
+        };
+        size_t n_opt() const { return _n_opt; };
+        size_t n_traj() const { return _n_traj; };
+
+    private:
+        struct Chunk {
+            std::vector<uint64_t> id;
+            std::vector<double> time, objective, seconds;
+            std::vector<int32_t> init_status, solve_status, iterations;
+            std::vector<double> p_opt, trajectory;
+
+            size_t size() const { return id.size(); };
+            void reserve(const size_t rows, const size_t n_opt, const size_t n_traj) {
+                id.reserve(rows); time.reserve(rows); objective.reserve(rows); seconds.reserve(rows);
+                init_status.reserve(rows); solve_status.reserve(rows); iterations.reserve(rows);
+                p_opt.reserve(rows * n_opt); trajectory.reserve(rows * n_traj);
+            };
+            void append(const Row &row, const size_t n_opt, const size_t n_traj) {
+                id.push_back(row.id); time.push_back(row.time);
+                objective.push_back(row.objective); seconds.push_back(row.seconds);
+                init_status.push_back(row.init_status); solve_status.push_back(row.solve_status);
+                iterations.push_back(row.iterations);
+                p_opt.insert(p_opt.end(), row.p_opt, row.p_opt + n_opt);
+                if (n_traj > 0) { trajectory.insert(trajectory.end(), row.trajectory, row.trajectory + n_traj); };
+            };
+            void clear() {
+                id.clear(); time.clear(); objective.clear(); seconds.clear();
+                init_status.clear(); solve_status.clear(); iterations.clear(); p_opt.clear(); trajectory.clear();
+            };
+        };
+        size_t _n_opt;
+        size_t _n_traj;
+        size_t _chunk_rows;
+        size_t _queue_capacity;
+        std::ofstream _file;
+        mutable std::mutex _mutex;
+        std::condition_variable _ready;   // Queue not empty (or closed)
+        std::condition_variable _space;   // Queue below capacity
+        std::condition_variable _drained; // Queue empty and nothing being written
+        Chunk _chunk;
+        std::deque<Chunk> _queue;
+        std::vector<Chunk> _spare;        // Written chunks -> reused, so memory stays flat
+        bool _closed = false;
+        bool _writing = false;
+        size_t _rows = 0;
+        std::exception_ptr _error;
+        std::thread _thread;
+
+        // Move the current chunk to the queue -> called with the lock held
+        void enqueue(std::unique_lock<std::mutex> &lock) {
+            _space.wait(lock, [this] () { return _queue.size() < _queue_capacity || _error; });
+            if (_error) { std::rethrow_exception(_error); };
+            _queue.push_back(std::move(_chunk));
+            if (_spare.empty()) {
+                _chunk = Chunk();
+                _chunk.reserve(_chunk_rows, _n_opt, _n_traj);
+            } else {
+                _chunk = std::move(_spare.back());
+                _spare.pop_back();
+            };
+            _ready.notify_one();
+        };
+        void drain() {
+            std::unique_lock<std::mutex> _lock(_mutex);
+            while (true) {
+                _ready.wait(_lock, [this] () { return !_queue.empty() || _closed; });
+                if (_queue.empty()) { break; };
+                Chunk _next = std::move(_queue.front());
+                _queue.pop_front();
+                _writing = true;
+                _space.notify_one();
+                _lock.unlock();
+                try {
+                    write(_next);
+                } catch (...) {
+                    _lock.lock();
+                    _error = std::current_exception();
+                    _writing = false;
+                    _space.notify_all();
+                    _drained.notify_all();
+                    return;
+                };
+                size_t _written = _next.size();
+                _next.clear();
+                _lock.lock();
+                _writing = false;
+                _rows += _written;
+                _spare.push_back(std::move(_next));
+                if (_queue.empty()) { _drained.notify_all(); };
+            };
+            _drained.notify_all();
+        };
+        template <typename T>
+        void write_column(const std::vector<T> &column) {
+            _file.write(reinterpret_cast<const char *>(column.data()), sizeof(T) * column.size());
+        };
+        void write(const Chunk &chunk) {
+            ChunkHeader _header{chunk.size()};
+            _file.write(reinterpret_cast<const char *>(&_header), sizeof(ChunkHeader));
+            write_column(chunk.id); write_column(chunk.time); write_column(chunk.objective);
+            write_column(chunk.seconds); write_column(chunk.p_opt); write_column(chunk.trajectory);
+            write_column(chunk.init_status); write_column(chunk.solve_status); write_column(chunk.iterations);
+            const char _padding[8] = {};
+            _file.write(_padding, (8 - 3 * sizeof(int32_t) * chunk.size() % 8) % 8);
+            _file.flush();
+            if (!_file) { throw std::runtime_error("Cannot write result chunk"); };
+        };
+    };
+}
+
+#endif //SWITCHINGTIMES_RESULT_WRITER_HPP
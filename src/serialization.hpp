@@ -0,0 +1,78 @@
+#ifndef SWITCHINGTIMES_SERIALIZATION_HPP
+#define SWITCHINGTIMES_SERIALIZATION_HPP
+
+#include <Eigen/Dense>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+namespace SwitchingTimes {
+    /*
+     * Minimal binary (native endianness) writer/reader -> PODs, strings and Eigen vectors/matrices
+     */
+    class BinaryWriter {
+    public:
+        std::string buffer;
+
+        template <typename T>
+        void write(const T &value) {
+            static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable types");
+            buffer.append(reinterpret_cast<const char *>(&value), sizeof(T));
+        };
+        void write(const std::string &value) {
+            write<uint64_t>(value.size());
+            buffer.append(value);
+        };
+        template <typename scalar, int rows, int cols, int options, int max_rows, int max_cols>
+        void write(const Eigen::Matrix<scalar, rows, cols, options, max_rows, max_cols> &value) {
+            write<int64_t>(value.rows());
+            write<int64_t>(value.cols());
+            buffer.append(reinterpret_cast<const char *>(value.data()), sizeof(scalar) * value.size());
+        };
+    };
+    class BinaryReader {
+    public:
+        const char *data;
+        size_t size;
+        size_t position = 0;
+
+        BinaryReader(const std::string &buffer) : data(buffer.data()), size(buffer.size()) {};
+        BinaryReader(const char *data, size_t size) : data(data), size(size) {};
+
+        template <typename T>
+        T read() {
+            static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable types");
+            T _out;
+            std::memcpy(&_out, take(sizeof(T)), sizeof(T));
+            return _out;
+        };
+        void read(std::string &value) {
+            uint64_t _size = read<uint64_t>();
+            value.assign(take(_size), _size);
+        };
+        template <typename scalar, int rows, int cols, int options, int max_rows, int max_cols>
+        void read(Eigen::Matrix<scalar, rows, cols, options, max_rows, max_cols> &value) {
+            int64_t _rows = read<int64_t>();
+            int64_t _cols = read<int64_t>();
+            // Check the size against the remaining data before allocating -> by division, so it cannot overflow
+            uint64_t _max = (size - position) / sizeof(scalar);
+            if (_rows < 0 || _cols < 0 || (_cols > 0 && (uint64_t) _rows > _max / (uint64_t) _cols)) {
+                throw std::runtime_error("Unexpected end of serialized data");
+            };
+            value.resize(_rows, _cols);
+            std::memcpy(value.data(), take(sizeof(scalar) * _rows * _cols), sizeof(scalar) * _rows * _cols);
+        };
+
+    private:
+        const char *take(size_t n) {
+            if (n > size - position) { throw std::runtime_error("Unexpected end of serialized data"); };
+            const char *_out = data + position;
+            position += n;
+            return _out;
+        };
+    };
+}
+
+#endif //SWITCHINGTIMES_SERIALIZATION_HPP
@@ -0,0 +1,103 @@
+#ifndef SWITCHINGTIMES_SPEC_FILE_HPP
+#define SWITCHINGTIMES_SPEC_FILE_HPP
+
+#include <fstream>
+#include <istream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "switching-times.hpp"
+
+namespace SwitchingTimes {
+    /*
+     * Text format of a batch of problems -> one section per problem, fields as in Spec plus the solver backend
+     *
+     *     # comment
+     *     [problem name]
+     *     model = wastewater
+     *     p_const = 0.00067 36.9 0.073 0.1 2. 0.3 7.84 0.5 0. 1. 1. 1.
+     *     t0 = 0.
+     *     ...
+     *     solver = ipopt
+     *     continuation = 0.1 0.3 1.    # optional sharpness continuation, see NLP::solve
+     *
+     * Vectors are whitespace separated, unset fields keep the defaults of a new plant.
+     */
+    struct Problem {
+        std::string name;
+        Spec spec;
+        std::string solver = "ipopt";
+        std::vector<double> continuation;
+    };
+    inline std::vector<Problem> read_problems(std::istream &in) {
+        std::vector<Problem> _out;
+        std::string _line;
+        int _number = 0;
+        auto _error = [&] (const std::string &what) {
+            return std::invalid_argument("Line " + std::to_string(_number) + ": " + what);
+        };
+        while (std::getline(in, _line)) {
+            _number += 1;
+            size_t _comment = _line.find('#');
+            if (_comment != std::string::npos) { _line.erase(_comment); };
+            size_t _first = _line.find_first_not_of(" \t\r");
+            if (_first == std::string::npos) { continue; };
+            _line = _line.substr(_first, _line.find_last_not_of(" \t\r") - _first + 1);
+            if (_line.front() == '[') {
+                if (_line.back() != ']') { throw _error("Expected ']' at the end of a section"); };
+                _out.push_back(Problem{_line.substr(1, _line.size() - 2), Spec(), "ipopt"});
+                continue;
+            };
+            if (_out.empty()) { throw _error("Field outside of a [problem] section"); };
+            size_t _equal = _line.find('=');
+            if (_equal == std::string::npos) { throw _error("Expected 'field = value'"); };
+            std::string _key = _line.substr(0, _line.find_last_not_of(" \t", _equal - 1) + 1);
+            std::istringstream _value(_line.substr(_equal + 1));
+            Spec &spec = _out.back().spec;
+            auto _vector = [&] () {
+                std::vector<double> _values;
+                double _x;
+                while (_value >> _x) { _values.push_back(_x); };
+                if (!_value.eof()) { throw _error("Invalid number in '" + _key + "'"); };
+                return vector<double>(Eigen::Map<const vector<double>>(_values.data(), _values.size()));
+            };
+            auto _scalar = [&] () {
+                vector<double> _values = _vector();
+                if (_values.size() != 1) { throw _error("Expected a single number in '" + _key + "'"); };
+                return _values(0);
+            };
+            auto _word = [&] () {
+                std::string _w;
+                _value >> _w;
+                return _w;
+            };
+            if (_key == "p_const") { spec.p_const = _vector(); }
+            else if (_key == "p_dynamic") { spec.p_dynamic = _vector(); }
+            else if (_key == "p_optimize") { spec.p_optimize = _vector(); }
+            else if (_key == "x0") { spec.x0 = _vector(); }
+            else if (_key == "t0") { spec.t0 = _scalar(); }
+            else if (_key == "tf") { spec.tf = _scalar(); }
+            else if (_key == "dt") { spec.dt = _scalar(); }
+            else if (_key == "lower_bound") { spec.lower_bound = _vector(); }
+            else if (_key == "upper_bound") { spec.upper_bound = _vector(); }
+            else if (_key == "on_bound") { spec.on_bound = _vector(); }
+            else if (_key == "off_bound") { spec.off_bound = _vector(); }
+            else if (_key == "model") { spec.model = _word(); }
+            else if (_key == "solver") { _out.back().solver = _word(); }
+            else if (_key == "continuation") {
+                vector<double> _factors = _vector();
+                _out.back().continuation.assign(_factors.data(), _factors.data() + _factors.size());
+            }
+            else { throw _error("Unknown field '" + _key + "'"); };
+        };
+        return _out;
+    };
+    inline std::vector<Problem> read_problems(const std::string &path) {
+        std::ifstream _file(path);
+        if (!_file) { throw std::runtime_error("Cannot open problem file '" + path + "'"); };
+        return read_problems(_file);
+    };
+}
+
+#endif //SWITCHINGTIMES_SPEC_FILE_HPP
@@ -0,0 +1,219 @@
+#ifndef SWITCHINGTIMES_SWITCHING_TIMES_BACKTEST_HPP
+#define SWITCHINGTIMES_SWITCHING_TIMES_BACKTEST_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+#include "parallel.hpp"
+#include "price-store.hpp"
+#include "result-writer.hpp"
+#include "switching-times.hpp"
+
+namespace SwitchingTimes {
+    /*
+     * Rolling daily optimization over a historical price series
+     *
+     * Day d optimizes the window of the configured plant starting at _start + d * _period (window-relative time, as
+     * in RecedingHorizon), applies the first _period minutes of its schedule and hands the end state to day d + 1.
+     * State components not in _carried restart from the plant's x0 every day (e.g. the cost accumulators).
+     *
+     * Exact mode solves the days in order. Speculative mode predicts every x0 by a forward simulation of the warm
+     * start schedule, solves all days in parallel and then corrects: a sequential pass chains the true states
+     * through the solved schedules, days whose x0 deviates by more than _tol are solved again (in parallel) from the
+     * chained state. The days before the first deviation are final, so every pass finalizes at least one day.
+     */
+    class Backtest {
+    public:
+        struct Day {
+            double time = 0.;      // Absolute start of the day
+            vector<double> x0;     // Initial state the schedule was optimized for
+            vector<double> p_opt;  // Optimal schedule (window-relative)
+            double objective = 0.;
+            int init_status = 0;
+            int status = 0;
+            int iterations = 0;
+            double seconds = 0.;   // Wall time of the last solve
+            int solves = 0;        // Number of solves (> 1 after speculative corrections)
+        };
+        struct Report {
+            size_t final;          // Days done
+            size_t days;
+            size_t solves;         // Solves so far (days + corrections)
+            double seconds;
+            double days_per_second;
+        };
+        NLP &_nlp;
+        const PriceStore &_store;
+        double _start;                   // Absolute time of the first day
+        double _period;                  // Applied part of each day's schedule
+        size_t _days;
+        size_t _threads = max_threads();
+        bool _speculative = false;
+        double _tol = 1e-3;              // Accepted deviation of a speculative x0 (carried states, max norm)
+        std::vector<int> _carried;       // State components carried between days -> empty means all
+        ResultWriter *_writer = nullptr; // Final days are streamed here (id = day)
+        std::function<bool(const Report &)> _callback; // Progress -> return false to stop
+        std::vector<Day> _results;
+
+        Backtest(NLP &nlp, const PriceStore &store, const double start, const double period, const size_t days) :
+                _nlp(nlp), _store(store), _start(start), _period(period), _days(days) {
+            const Plant &_base = *_nlp.plant;
+            if (!(period > 0.) || period > _base._tf - _base._t0) {
+                throw std::invalid_argument("Expected 0 < period <= tf - t0");
+            };
+            if (days > 0 && first(days - 1) + n_window() > _store.size()) {
+                throw std::out_of_range("The price store does not cover the last day's window");
+            };
+        };
+
+        std::vector<Day> run() {
+            TRACE_SCOPE("backtest", "backtest");
+            (*_nlp.plant).check_model();
+            _results.assign(_days, Day());
+            _solves = 0;
+            _clock = std::chrono::steady_clock::now();
+            prepare_workers();
+            if (_speculative) { run_speculative(); } else { run_exact(); };
+            return _results;
+        };
+        const std::vector<Day> &get_results() const { return _results; };
+
+    private:
+        std::vector<SmartPtr<Plant>> _workers;
+        size_t _solves = 0;
+        size_t _reported = 0; // Final days passed to the writer
+        std::chrono::steady_clock::time_point _clock;
+
+        size_t n_window() const { return ((*_nlp.plant)._p_dynamic.size() - 1) / 2; };
+        double day_time(const size_t day) const { return _start + day * _period; };
+        size_t first(const size_t day) const { return _store.locate(day_time(day)); };
+        // One plant per thread configured as the base plant -> each keeps its tape across days
+        void prepare_workers() {
+            const Plant &_base = *_nlp.plant;
+            size_t _n = std::max<size_t>(1, _speculative ? std::min(_threads, _days) : 1);
+            while (_workers.size() < _n) { _workers.push_back(new Plant()); };
+            for(SmartPtr<Plant> &_worker : _workers) {
+                (*_worker).set_p_optimize(_base._p_opt);
+                (*_worker).set_lower_bound(_base._lower_bound);
+                (*_worker).set_upper_bound(_base._upper_bound);
+                (*_worker).copy_configuration(_base);
+            };
+        };
+        // Load the day's prices into a plant -> (prices; window-relative price times) as in RecedingHorizon
+        void load_day(Plant &plant, const size_t day) const {
+            vector<double> _p_dynamic(plant._p_dynamic.size());
+            _store.window(first(day), n_window(), day_time(day) - plant._t0, _p_dynamic.data());
+            plant.set_p_dynamic(_p_dynamic);
+        };
+        // Initial state of a day from the end state of the previous one
+        vector<double> carry(const vector<double> &x) const {
+            const vector<double> &_x0 = (*_nlp.plant)._x0;
+            if (_carried.empty()) { return x; };
+            vector<double> _out = _x0;
+            for(int i : _carried) { _out(i) = x(i); };
+            return _out;
+        };
+        double deviation(const vector<double> &a, const vector<double> &b) const {
+            if (_carried.empty()) { return (a - b).cwiseAbs().maxCoeff(); };
+            double _out = 0.;
+            for(int i : _carried) { _out = std::max(_out, std::abs(a(i) - b(i))); };
+            return _out;
+        };
+        void solve_day(const size_t day, const SmartPtr<Plant> &worker, const vector<double> &x0,
+                       const vector<double> &warm) {
+            Plant &_plant = *worker;
+            load_day(_plant, day);
+            _plant.set_x0(x0);
+            _plant.set_p_optimize(warm);
+            auto _start_solve = std::chrono::steady_clock::now();
+            _nlp.solve_plant(worker, 0);
+            std::chrono::duration<double> _elapsed = std::chrono::steady_clock::now() - _start_solve;
+            Day &_day = _results[day];
+            _day = Day{day_time(day), x0, _plant._p_opt_ipopt, _plant._objective, _plant._status_init,
+                       _plant._status_solve, _plant._iterations, _elapsed.count(), _day.solves + 1};
+        };
+        // End state of a day when its schedule is applied for _period
+        vector<double> simulate_day(const size_t day, Plant &plant, const vector<double> &x0,
+                                    const vector<double> &p_opt) const {
+            load_day(plant, day);
+            plant._p_opt = p_opt;
+            return plant.integrate(plant._t0, plant._t0 + _period, plant._dt, x0);
+        };
+        bool report(const size_t final) {
+            for(size_t d = _reported; d < final; ++d) {
+                if (_writer != nullptr) {
+                    const Day &_day = _results[d];
+                    (*_writer).push(ResultWriter::Row{d, _day.time, _day.objective, _day.seconds, _day.init_status,
+                                                      _day.status,
+                                                      _day.iterations, _day.p_opt.data(), nullptr});
+                };
+            };
+            _reported = std::max(_reported, final);
+            if (!_callback) { return true; };
+            std::chrono::duration<double> _elapsed = std::chrono::steady_clock::now() - _clock;
+            return _callback(Report{final, _days, _solves, _elapsed.count(),
+                                    _elapsed.count() > 0. ? final / _elapsed.count() : 0.});
+        };
+
+        void run_exact() {
+            _reported = 0;
+            Plant &_plant = *_workers[0];
+            vector<double> _x = (*_nlp.plant)._x0;
+            vector<double> _warm = (*_nlp.plant)._p_opt;
+            for(size_t d = 0; d < _days; ++d) {
+                vector<double> _x0 = carry(_x);
+                solve_day(d, _workers[0], _x0, _warm);
+                _solves += 1;
+                _x = simulate_day(d, _plant, _x0, _results[d].p_opt);
+                _warm = _results[d].p_opt;
+                if (!report(d + 1)) { _results.resize(d + 1); return; };
+            };
+        };
+        void run_speculative() {
+            _reported = 0;
+            Plant &_chain = *_workers[0];
+            const vector<double> &_warm = (*_nlp.plant)._p_opt;
+            // Predicted initial states -> forward simulation of the warm start schedule
+            std::vector<vector<double>> _used(_days);
+            vector<double> _x = (*_nlp.plant)._x0;
+            for(size_t d = 0; d < _days; ++d) {
+                _used[d] = carry(_x);
+                _x = simulate_day(d, _chain, _used[d], _warm);
+            };
+            std::vector<size_t> _pending(_days);
+            for(size_t d = 0; d < _days; ++d) { _pending[d] = d; };
+            size_t _final = 0;
+            vector<double> _x_final = (*_nlp.plant)._x0; // End state of the last final day
+            while (_final < _days) {
+                parallel_for(_pending.size(), _workers.size(), [&] (size_t k, size_t thread) {
+                    size_t d = _pending[k];
+                    // Corrections start from the previous solution of the day
+                    const vector<double> &_start_p = _results[d].solves > 0 ? _results[d].p_opt : _warm;
+                    solve_day(d, _workers[thread], _used[d], vector<double>(_start_p));
+                });
+                _solves += _pending.size();
+                // Chain the true states through the solved schedules
+                _pending.clear();
+                _x = _x_final;
+                for(size_t d = _final; d < _days; ++d) {
+                    vector<double> _x0 = carry(_x);
+                    if (deviation(_x0, _used[d]) > _tol) {
+                        _used[d] = _x0;
+                        _pending.push_back(d);
+                    } else if (_pending.empty()) {
+                        _final = d + 1;
+                    };
+                    _x = simulate_day(d, _chain, _x0, _results[d].p_opt);
+                    if (_final == d + 1) { _x_final = _x; };
+                };
+                TRACE_INSTANT("backtest_pass", "backtest", "final", _final);
+                if (!report(_final)) { _results.resize(_final); return; };
+            };
+        };
+    };
+}
+
+#endif //SWITCHINGTIMES_SWITCHING_TIMES_BACKTEST_HPP
@@ -0,0 +1,396 @@
+#ifndef SWITCHINGTIMES_SWITCHING_TIMES_COLLOCATION_HPP
+#define SWITCHINGTIMES_SWITCHING_TIMES_COLLOCATION_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "switching-times.hpp"
+
+namespace SwitchingTimes {
+    /*
+     * Direct (trapezoidal) collocation formulation of a configured plant
+     *
+     * The horizon is cut into N intervals of length h and the states x_1, ..., x_N at the grid points
+     * t_k = t0 + k * h become decision variables (x_0 = x0 is fixed):
+     *     z = (p_opt; x_1; ...; x_N)
+     *     g = (duration constraints of the plant; x_{k+1} - x_k - h / 2 * (f(x_k, t_k) + f(x_{k+1}, t_{k+1}))) with
+     *         the defect rows fixed at 0
+     *     f = cost(x_N)
+     * where f(x, t) is Plant::model. A single tape F(z) = (cost; defects) is recorded with the dynamical parameters
+     * of Plant::dynamic_parameters. Defect k only depends on p_opt, x_k and x_{k+1}, so the sparsity patterns of the
+     * Jacobian and of the Hessian of the Lagrangian (CppAD set-based detection, computed once per prepare) have
+     * O(N) entries and the colorings need a number of sweeps independent of N -> memory and time grow linearly in N.
+     * IPOPT runs with the exact Hessian.
+     */
+    class CollocationPlant: public TNLP {
+    public:
+        SmartPtr<Plant> _plant;
+        int _intervals = 0;        // Grid intervals N -> 0 means one interval per integration step dt
+        // IPOPT application status
+        int _status_init = 0;
+        int _status_solve = 0;
+        double _objective = 0.;
+        vector<double> _z_opt;     // Solution (p_opt; x_1; ...; x_N)
+        matrix<double> _states;    // Grid states x_0, ..., x_N at the solution -> one row per grid point
+
+        // Build the grid, record the tape and detect the sparsity patterns -> called before every solve
+        void prepare() {
+            Plant &plant = *_plant;
+            plant.check_model();
+            if (!(plant._dt > 0.)) { throw std::invalid_argument("Expected dt > 0"); };
+            if (plant._w_scenarios.size() > 0) {
+                throw std::invalid_argument("Collocation does not support scenarios -> clear them first");
+            };
+            _n_p = plant._p_opt.size();
+            _n_x = plant._x0.size();
+            double _horizon = plant._tf - plant._t0;
+            _n = _intervals > 0 ? _intervals : std::max(1, (int) std::lround(_horizon / plant._dt));
+            _h = _horizon / _n;
+            _dynamic = plant.dynamic_parameters(plant._p_dynamic);
+            _window = plant.sharpness_floor();
+            // Starting point -> single-shooting trajectory of the current schedule at the grid points
+            _start = vector<double>::Zero(n_z());
+            _start.head(_n_p) = plant._p_opt;
+            int _substeps = std::max(1, (int) std::ceil(_h / plant._dt - 1e-9));
+            vector<double> p_const = _dynamic.tail(plant._p_const.size());
+            PriceCurve<double> prices(_dynamic, plant._price_index);
+            vector<double> _x = plant._x0;
+            uint64_t _rhs = 0;
+            for(int k = 0; k < _n; ++k) {
+                (*plant._model).integrate_steps(_x, grid(k), _h / _substeps, _substeps, nullptr, prices, plant._p_opt,
+                                                p_const, _rhs);
+                _start.segment(state_offset(k + 1), _n_x) = _x;
+            };
+            // Record F(z) = (cost; defects)
+            {
+                TRACE_SCOPE("record_tape", "tape");
+                vector<ad_double> _z = _start.cast<ad_double>();
+                vector<ad_double> _dyn = _dynamic.cast<ad_double>();
+                size_t abort_op_index = 0;
+                bool record_compare = true;
+                CppAD::Independent(_z, abort_op_index, record_compare, _dyn);
+                vector<ad_double> _out = residuals<ad_double>(_dyn, _z);
+                _tape = ad_function(_z, _out);
+            };
+            // Jacobian pattern -> forward propagation of the identity with sets (bool matrices would be O(n^2))
+            TRACE_SCOPE("collocation_sparsity", "tape");
+            size_t n = n_z();
+            sparse_pattern _identity(n, n, n);
+            for(size_t k = 0; k < n; ++k) { _identity.set(k, k, k); };
+            _tape.for_jac_sparsity(_identity, false, false, false, _jac_pattern);
+            _jac = sparse_values(_jac_pattern);
+            _jac_work.clear();
+            // Hessian pattern of any weighted sum of the outputs -> lower triangle for IPOPT
+            std::vector<bool> _select(n_out(), true);
+            _tape.rev_hes_sparsity(_select, false, false, _hes_pattern);
+            size_t _lower = 0;
+            for(size_t k = 0; k < _hes_pattern.nnz(); ++k) {
+                if (_hes_pattern.row()[k] >= _hes_pattern.col()[k]) { _lower += 1; };
+            };
+            sparse_pattern _hes_subset(n, n, _lower);
+            for(size_t k = 0, j = 0; k < _hes_pattern.nnz(); ++k) {
+                if (_hes_pattern.row()[k] >= _hes_pattern.col()[k]) {
+                    _hes_subset.set(j++, _hes_pattern.row()[k], _hes_pattern.col()[k]);
+                };
+            };
+            _hes = sparse_values(_hes_subset);
+            _hes_work.clear();
+            _values_at.resize(0);
+            _jacobian_at.resize(0);
+        };
+        int n_intervals() const { return _n; };
+        int n_z() const { return _n_p + _n * _n_x; };
+        int n_duration() const { return std::max(0, _n_p - 1); };
+        size_t nnz_jacobian() const { return _jac.nnz(); };
+        size_t nnz_hessian() const { return _hes.nnz(); };
+
+        bool get_nlp_info(
+                Index&          n,
+                Index&          m,
+                Index&          nnz_jac_g,
+                Index&          nnz_h_lag,
+                IndexStyleEnum& index_style
+        ){
+            n = n_z();
+            m = n_duration() + _n * _n_x;
+            nnz_jac_g = 2 * n_duration();
+            for(size_t k = 0; k < _jac.nnz(); ++k) { if (_jac.row()[k] > 0) { nnz_jac_g += 1; }; };
+            nnz_h_lag = _hes.nnz();
+            index_style = TNLP::C_STYLE;
+            return true;
+        };
+        bool get_bounds_info(
+                Index   n,
+                Number* x_l,
+                Number* x_u,
+                Index   m,
+                Number* g_l,
+                Number* g_u
+        ){
+            const Plant &plant = *_plant;
+            for(int k = 0; k < _n_p; ++k) { x_l[k] = plant._lower_bound(k); x_u[k] = plant._upper_bound(k); };
+            for(int k = _n_p; k < n; ++k) { x_l[k] = -2e19; x_u[k] = 2e19; };
+            int _tmp = _n_p / 2;
+            for(int k = 0; k < _tmp; ++k) { g_l[k] = plant._on_bound(0); g_u[k] = plant._on_bound(1); };
+            for(int k = 0; k < _tmp - 1; ++k) { g_l[_tmp + k] = plant._off_bound(0); g_u[_tmp + k] = plant._off_bound(1); };
+            for(int k = n_duration(); k < m; ++k) { g_l[k] = 0.; g_u[k] = 0.; };
+            return true;
+        };
+        bool get_starting_point(
+                Index   n,
+                bool    init_x,
+                Number* x,
+                bool    init_z,
+                Number* z_L,
+                Number* z_U,
+                Index   m,
+                bool    init_lambda,
+                Number* lambda
+        ){
+            for(int k = 0; k < n; ++k) { x[k] = _start(k); };
+            return true;
+        };
+        bool eval_f(
+                Index         n,
+                const Number* x,
+                bool          new_x,
+                Number&       obj_value
+        )
+        {
+            TRACE_SCOPE("collocation_eval_f", "callback");
+            evaluate(x);
+            obj_value = _values[0];
+            return true;
+        };
+        bool eval_grad_f(
+                Index         n,
+                const Number* x,
+                bool          new_x,
+                Number*       grad_f
+        )
+        {
+            TRACE_SCOPE("collocation_eval_grad_f", "callback");
+            differentiate(x);
+            for(int k = 0; k < n; ++k) { grad_f[k] = 0.; };
+            for(size_t k = 0; k < _jac.nnz(); ++k) {
+                if (_jac.row()[k] == 0) { grad_f[_jac.col()[k]] = _jac.val()[k]; };
+            };
+            return true;
+        };
+        bool eval_g(
+                Index         n,
+                const Number* x,
+                bool          new_x,
+                Index         m,
+                Number*       g
+        )
+        {
+            int _tmp = _n_p / 2;
+            for(int k = 0; k < _tmp; ++k) { g[k] = x[_tmp + k] - x[k]; };
+            for(int k = 0; k < _tmp - 1; ++k) { g[_tmp + k] = x[k + 1] - x[_tmp + k]; };
+            evaluate(x);
+            for(int k = 0; k < _n * _n_x; ++k) { g[n_duration() + k] = _values[1 + k]; };
+            return true;
+        };
+        bool eval_jac_g(
+                Index         n,
+                const Number* x,
+                bool          new_x,
+                Index         m,
+                Index         nele_jac,
+                Index*        iRow,
+                Index*        jCol,
+                Number*       values
+        )
+        {
+            int _count = 0;
+            int _tmp = _n_p / 2;
+            if( values == NULL )
+            {
+                // Duration rows -> as Plant::eval_jac_g
+                for(int k = 0; k < _tmp; ++k) {
+                    iRow[_count] = k; jCol[_count] = k; _count += 1;
+                    iRow[_count] = k; jCol[_count] = _tmp + k; _count += 1;
+                };
+                for(int k = 0; k < _tmp - 1; ++k) {
+                    iRow[_count] = _tmp + k; jCol[_count] = k + 1; _count += 1;
+                    iRow[_count] = _tmp + k; jCol[_count] = _tmp + k; _count += 1;
+                };
+                // Defect rows -> detected pattern without the cost row
+                for(size_t k = 0; k < _jac.nnz(); ++k) {
+                    if (_jac.row()[k] == 0) { continue; };
+                    iRow[_count] = n_duration() + _jac.row()[k] - 1;
+                    jCol[_count] = _jac.col()[k];
+                    _count += 1;
+                };
+            }
+            else
+            {
+                for(int k = 0; k < _tmp; ++k) { values[_count++] = -1.; values[_count++] = 1.; };
+                for(int k = 0; k < _tmp - 1; ++k) { values[_count++] = 1.; values[_count++] = -1.; };
+                differentiate(x);
+                for(size_t k = 0; k < _jac.nnz(); ++k) {
+                    if (_jac.row()[k] > 0) { values[_count++] = _jac.val()[k]; };
+                };
+            };
+            return true;
+        };
+        bool eval_h(
+                Index         n,
+                const Number* x,
+                bool          new_x,
+                Number        obj_factor,
+                Index         m,
+                const Number* lambda,
+                bool          new_lambda,
+                Index         nele_hess,
+                Index*        iRow,
+                Index*        jCol,
+                Number*       values
+        )
+        {
+            if( values == NULL )
+            {
+                for(size_t k = 0; k < _hes.nnz(); ++k) { iRow[k] = _hes.row()[k]; jCol[k] = _hes.col()[k]; };
+            }
+            else
+            {
+                TRACE_SCOPE("collocation_eval_h", "callback");
+                // Weights of F = (cost; defects) -> the duration rows are linear
+                std::vector<double> _w(n_out());
+                _w[0] = obj_factor;
+                for(int k = 0; k < _n * _n_x; ++k) { _w[1 + k] = lambda[n_duration() + k]; };
+                _tape.sparse_hes(point(x), _w, _hes, _hes_pattern, "cppad.symmetric", _hes_work);
+                for(size_t k = 0; k < _hes.nnz(); ++k) { values[k] = _hes.val()[k]; };
+            };
+            return true;
+        };
+        void finalize_solution(
+                SolverReturn               status,
+                Index                      n,
+                const Number*              x,
+                const Number*              z_L,
+                const Number*              z_U,
+                Index                      m,
+                const Number*              g,
+                const Number*              lambda,
+                Number                     obj_value,
+                const IpoptData*           ip_data,
+                IpoptCalculatedQuantities* ip_cq
+        )
+        {
+            _objective = obj_value;
+            _z_opt = Eigen::Map<const vector<double>>(x, n);
+            _states = matrix<double>::Zero(_n + 1, _n_x);
+            _states.row(0) = (*_plant)._x0.transpose();
+            for(int k = 1; k <= _n; ++k) { _states.row(k) = _z_opt.segment(state_offset(k), _n_x).transpose(); };
+            // Hand the schedule back to the plant -> plant.get_p_optimize_ipopt() and get_objective() work
+            Plant &plant = *_plant;
+            plant._p_opt_ipopt = _z_opt.head(_n_p);
+            plant._objective = obj_value;
+        };
+
+    private:
+        typedef std::vector<size_t> sparse_index;
+        typedef CppAD::sparse_rc<sparse_index> sparse_pattern;
+        typedef CppAD::sparse_rcv<sparse_index, std::vector<double>> sparse_values;
+        int _n_p = 0;
+        int _n_x = 0;
+        int _n = 0;                              // Grid intervals
+        double _h = 0.;
+        vector<double> _dynamic;                 // Dynamical parameters of the tape
+        double _window = 0.;                     // Price window sharpness of the tape -> see Plant::sharpness_floor
+        vector<double> _start;
+        ad_function _tape;
+        sparse_pattern _jac_pattern, _hes_pattern;  // Detected patterns of F and of the Hessian of any w^T F
+        sparse_values _jac;                      // All entries of the Jacobian of F (row 0 is the cost gradient)
+        sparse_values _hes;                      // Lower triangle of the Hessian of the Lagrangian
+        CppAD::sparse_jac_work _jac_work;        // Colorings -> computed at the first sweep after prepare
+        CppAD::sparse_hes_work _hes_work;
+        static const size_t group_max = 8;       // Colors per forward sweep of sparse_jac_for
+        vector<double> _values_at, _jacobian_at; // x of the cached values and Jacobian
+        std::vector<double> _values;             // F(x) = (cost; defects)
+
+        double grid(const int k) const { return (*_plant)._t0 + k * _h; };
+        int state_offset(const int k) const { return _n_p + (k - 1) * _n_x; };
+        size_t n_out() const { return 1 + _n * _n_x; };
+        // Trapezoidal residuals of z -> (cost of x_N; defects of the N intervals)
+        template <typename scalar>
+        vector<scalar> residuals(const vector<scalar> &dynamic, const vector<scalar> &z) {
+            Plant &plant = *_plant;
+            vector<scalar> p_opt = z.head(_n_p);
+            vector<scalar> p_const = dynamic.tail(plant._p_const.size());
+            PriceCurve<scalar> prices(dynamic, plant._price_index);
+            prices.window_sharpness = _window;
+            vector<scalar> _out(1 + _n * _n_x);
+            vector<scalar> _x = dynamic.segment(plant._p_dynamic.size(), _n_x);
+            vector<scalar> _f(_n_x), _f_next(_n_x);
+            plant.model(_x, _f, grid(0), prices, p_opt, p_const);
+            for(int k = 0; k < _n; ++k) {
+                vector<scalar> _x_next = z.segment(state_offset(k + 1), _n_x);
+                plant.model(_x_next, _f_next, grid(k + 1), prices, p_opt, p_const);
+                _out.segment(1 + k * _n_x, _n_x) = _x_next - _x - (0.5 * _h) * (_f + _f_next);
+                _x = _x_next;
+                _f.swap(_f_next);
+            };
+            _out(0) = plant.objective(_x, dynamic, p_opt, p_const);
+            return _out;
+        };
+        std::vector<double> point(const Number *x) const { return std::vector<double>(x, x + n_z()); };
+        bool cached(vector<double> &at, const Number *x) const {
+            Eigen::Map<const vector<double>> _x(x, n_z());
+            if (at.size() == _x.size() && at == _x) { return true; };
+            at = _x;
+            return false;
+        };
+        void evaluate(const Number *x) {
+            if (cached(_values_at, x)) { return; };
+            _values = _tape.Forward(0, point(x));
+        };
+        // Sparse Jacobian of F -> column coloring, so the number of forward sweeps does not grow with N
+        void differentiate(const Number *x) {
+            if (cached(_jacobian_at, x)) { return; };
+            TRACE_SCOPE("collocation_jacobian", "tape");
+            _tape.sparse_jac_for(group_max, point(x), _jac, _jac_pattern, "cppad", _jac_work);
+        };
+    };
+    class Collocation {
+    public:
+        SmartPtr<CollocationPlant> collocation;
+        int _print_level = 0;
+        Collocation(const NLP &nlp) {
+            collocation = new CollocationPlant();
+            (*collocation)._plant = nlp.plant;
+        };
+        // Set functions
+        void set_intervals(const int intervals) { (*collocation)._intervals = intervals; };
+        void set_print_level(const int print_level) { _print_level = print_level; };
+        // Get functions
+        const vector<double> &get_p_optimize_ipopt() const { return (*(*collocation)._plant)._p_opt_ipopt; };
+        const matrix<double> &get_states() const { return (*collocation)._states; };
+        const double &get_objective() const { return (*collocation)._objective; };
+        const int &get_init_status() const { return (*collocation)._status_init; };
+        const int &get_solve_status() const { return (*collocation)._status_solve; };
+        int get_intervals() const { return (*collocation).n_intervals(); };
+        size_t get_nnz_jacobian() const { return (*collocation).nnz_jacobian(); };
+        size_t get_nnz_hessian() const { return (*collocation).nnz_hessian(); };
+        // Solver wrapper
+        void solve() {
+            TRACE_SCOPE("collocation_solve", "solve");
+            (*collocation).prepare();
+            SmartPtr<IpoptApplication> app = ipopt_application(_print_level);
+            // The Hessian of the Lagrangian is sparse and exact -> no quasi-Newton approximation
+            std::string tag = "hessian_approximation";
+            std::string val = "exact";
+            app->Options()->SetStringValue(tag, val);
+            (*collocation)._status_init = (int) app->Initialize();
+            (*collocation)._status_solve = (int) app->OptimizeTNLP(collocation);
+            (*(*collocation)._plant)._status_init = (*collocation)._status_init;
+            (*(*collocation)._plant)._status_solve = (*collocation)._status_solve;
+        };
+    };
+}
+
+#endif //SWITCHINGTIMES_SWITCHING_TIMES_COLLOCATION_HPP
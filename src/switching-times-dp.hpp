@@ -0,0 +1,184 @@
+#ifndef SWITCHINGTIMES_SWITCHING_TIMES_DP_HPP
+#define SWITCHINGTIMES_SWITCHING_TIMES_DP_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+#include "parallel.hpp"
+#include "switching-times.hpp"
+
+namespace SwitchingTimes {
+    /*
+     * Dynamic-programming initializer of the switching schedule
+     *
+     * The horizon is cut into slots of (about) _slot minutes, each slot is either ON or OFF. A node is the regime
+     * with the number of ON runs so far and the length of the current run, so the DP only builds schedules with
+     * exactly n_s ON runs whose ON/OFF lengths respect _on_bound/_off_bound (the OFF runs before the first and
+     * after the last ON run are free, as in the NLP). Every node carries the plant state of its best path: the
+     * model is rolled out over a slot with the regime held constant (_substeps RK4 steps) and the Mayer cost of
+     * the state is the node value. Rollouts of the nodes of a slot run in parallel.
+     *
+     * The best discrete schedule is returned in the switching layout (ON-vec; OFF-vec) of the NLP.
+     */
+    class DynamicProgram {
+    public:
+        NLP &_nlp;
+        double _slot = 5.;         // Slot length -> rounded to divide the horizon
+        int _substeps = 4;         // RK4 steps per slot in the rollouts
+        size_t _threads = max_threads();
+        double _objective = 0.;    // DP estimate of the cost of the returned schedule
+
+        DynamicProgram(NLP &nlp) : _nlp(nlp) {};
+
+        vector<double> run() {
+            TRACE_SCOPE("dp_init", "init");
+            Plant &_plant = *_nlp.plant;
+            _plant.check_model();
+            int n_s = _plant._p_opt.size() / 2;
+            if (n_s == 0) { return vector<double>(); };
+            double _horizon = _plant._tf - _plant._t0;
+            int n_slots = std::max(1, (int) std::lround(_horizon / _slot));
+            _h = _horizon / n_slots;
+            // Runs longer than the horizon are unreachable -> clamp to n_slots (also "unbounded" bounds like 2e19)
+            _on_min = min_slots(_plant._on_bound(0), n_slots);
+            _on_max = max_slots(_plant._on_bound(1), n_slots);
+            _off_min = min_slots(_plant._off_bound(0), n_slots);
+            _off_max = max_slots(_plant._off_bound(1), n_slots);
+            if (_on_min > _on_max || (n_s > 1 && _off_min > _off_max)) {
+                throw std::invalid_argument("No slot count satisfies the ON/OFF bounds -> use shorter slots");
+            };
+            _n_s = n_s;
+            size_t n_nodes = node_count();
+            // Labels of the current slot boundary
+            const double _inf = std::numeric_limits<double>::infinity();
+            std::vector<double> _value(n_nodes, _inf);
+            std::vector<vector<double>> _x(n_nodes);
+            std::vector<std::vector<int>> _parent(n_slots, std::vector<int>(n_nodes, -1));
+            _value[initial()] = _plant.objective(_plant._x0, _plant._p_dynamic, _plant._p_opt, _plant._p_const);
+            _x[initial()] = _plant._x0;
+            PriceCurve<double> prices(_plant._p_dynamic, _plant._price_index);
+            for(int j = 0; j < n_slots; ++j) {
+                std::vector<int> _active;
+                for(size_t k = 0; k < n_nodes; ++k) { if (_value[k] < _inf) { _active.push_back(k); }; };
+                // Rollouts over slot j for both regimes -> parallel over the active nodes
+                std::vector<vector<double>> _x_on(_active.size()), _x_off(_active.size());
+                std::vector<double> _c_on(_active.size()), _c_off(_active.size());
+                double _t = _plant._t0 + j * _h;
+                parallel_for(_active.size(), _threads, [&] (size_t a, size_t thread) {
+                    int k = _active[a];
+                    if (successor(k, true) >= 0) { _c_on[a] = rollout(_plant, prices, _x[k], _t, true, _x_on[a]); };
+                    if (successor(k, false) >= 0) { _c_off[a] = rollout(_plant, prices, _x[k], _t, false, _x_off[a]); };
+                });
+                std::vector<double> _next_value(n_nodes, _inf);
+                std::vector<vector<double>> _next_x(n_nodes);
+                for(size_t a = 0; a < _active.size(); ++a) {
+                    for(bool on : {true, false}) {
+                        int _to = successor(_active[a], on);
+                        double _c = on ? _c_on[a] : _c_off[a];
+                        if (_to < 0 || !(_c < _next_value[_to])) { continue; };
+                        _next_value[_to] = _c;
+                        _next_x[_to] = on ? _x_on[a] : _x_off[a];
+                        _parent[j][_to] = _active[a];
+                    };
+                };
+                _value.swap(_next_value);
+                _x.swap(_next_x);
+            };
+            // Best feasible end node -> backtrack the regime of every slot
+            int _best = -1;
+            for(size_t k = 0; k < n_nodes; ++k) {
+                if (terminal(k) && _value[k] < _inf && (_best < 0 || _value[k] < _value[_best])) { _best = k; };
+            };
+            if (_best < 0) { throw std::runtime_error("No schedule with " + std::to_string(n_s) + " switch pairs fits"); };
+            _objective = _value[_best];
+            std::vector<bool> _regime(n_slots);
+            for(int j = n_slots - 1, k = _best; j >= 0; --j) {
+                _regime[j] = is_on(k);
+                k = _parent[j][k];
+            };
+            return schedule(_regime, _plant);
+        };
+        // Run and use the result as the starting point of the NLP
+        vector<double> apply() {
+            vector<double> _p_opt = run();
+            (*_nlp.plant)._p_opt = _p_opt;
+            return _p_opt;
+        };
+
+    private:
+        /*
+         * Nodes -> 0: OFF before the first ON run, 1: OFF after the last ON run,
+         *          then ON (run c, length l) and OFF (after run c, length l) for l = 1..max
+         */
+        int _n_s = 0;
+        double _h = 0.;
+        int _on_min = 0, _on_max = 0, _off_min = 0, _off_max = 0;
+
+        // Clamped in double before the cast -> min_slots returns n_slots + 1 for runs that cannot fit
+        int min_slots(const double length, const int n_slots) const {
+            return (int) std::max(1., std::min(std::ceil(length / _h - 1e-9), n_slots + 1.));
+        };
+        int max_slots(const double length, const int n_slots) const {
+            return (int) std::max(0., std::min(std::floor(length / _h + 1e-9), (double) n_slots));
+        };
+        size_t node_count() const { return 2 + _n_s * _on_max + std::max(0, _n_s - 1) * _off_max; };
+        int initial() const { return 0; };
+        int trailing() const { return 1; };
+        int on_node(const int c, const int l) const { return 2 + c * _on_max + (l - 1); };
+        int off_node(const int c, const int l) const { return 2 + _n_s * _on_max + (c - 1) * _off_max + (l - 1); };
+        bool is_on(const int k) const { return k >= 2 && k < 2 + _n_s * _on_max; };
+        bool terminal(const int k) const {
+            if (k == trailing()) { return true; };
+            // Ending in the last ON run -> it is cut at tf
+            return is_on(k) && (k - 2) / _on_max == _n_s - 1 && (k - 2) % _on_max + 1 >= _on_min;
+        };
+        // Node after one more slot in the given regime (-1 if not allowed)
+        int successor(const int k, const bool on) const {
+            if (k == initial()) { return on ? on_node(0, 1) : initial(); };
+            if (k == trailing()) { return on ? -1 : trailing(); };
+            if (is_on(k)) {
+                int c = (k - 2) / _on_max, l = (k - 2) % _on_max + 1;
+                if (on) { return l < _on_max ? on_node(c, l + 1) : -1; };
+                if (l < _on_min) { return -1; };
+                return c + 1 == _n_s ? trailing() : off_node(c + 1, 1);
+            };
+            int _offset = k - 2 - _n_s * _on_max;
+            int c = _offset / _off_max + 1, l = _offset % _off_max + 1;
+            if (!on) { return l < _off_max ? off_node(c, l + 1) : -1; };
+            return l >= _off_min ? on_node(c, 1) : -1;
+        };
+        // Constant regime over [t, t + _h) -> one switch pair far outside of the slot
+        double rollout(Plant &plant, const PriceCurve<double> &prices, const vector<double> &x0, const double t,
+                       const bool on, vector<double> &x) const {
+            const double _far = 1e6;
+            vector<double> _p_opt(2);
+            if (on) { _p_opt << t - _far, t + _far; } else { _p_opt << t + _far, t + 2. * _far; };
+            runge_kutta4<vector<double>> _stepper;
+            x = x0;
+            integrate_n_steps(_stepper, [&] (const vector<double> &x, vector<double> &dxdt, const double t) {
+                                  plant.model(x, dxdt, t, prices, _p_opt, plant._p_const);
+                              }, x, t, _h / _substeps, _substeps);
+            return plant.objective(x, plant._p_dynamic, _p_opt, plant._p_const);
+        };
+        // Regime per slot -> (ON-vec; OFF-vec) clipped to the variable bounds
+        vector<double> schedule(const std::vector<bool> &regime, const Plant &plant) const {
+            vector<double> _out = vector<double>::Zero(2 * _n_s);
+            int c = 0;
+            for(size_t j = 0; j < regime.size(); ++j) {
+                bool _before = j > 0 && regime[j - 1];
+                double _t = plant._t0 + j * _h;
+                if (regime[j] && !_before) { _out(c) = _t; };
+                if (!regime[j] && _before) { _out(_n_s + c) = _t; c += 1; };
+            };
+            if (c < _n_s) { _out(_n_s + c) = plant._tf; };
+            if (plant._lower_bound.size() == _out.size() && plant._upper_bound.size() == _out.size()) {
+                _out = _out.cwiseMax(plant._lower_bound).cwiseMin(plant._upper_bound);
+            };
+            return _out;
+        };
+    };
+}
+
+#endif //SWITCHINGTIMES_SWITCHING_TIMES_DP_HPP
@@ -0,0 +1,385 @@
+#ifndef SWITCHINGTIMES_SWITCHING_TIMES_FLEET_HPP
+#define SWITCHINGTIMES_SWITCHING_TIMES_FLEET_HPP
+
+#include <cmath>
+#include <memory>
+#include <vector>
+#include "parallel.hpp"
+#include "switching-times.hpp"
+
+namespace SwitchingTimes {
+    /*
+     * Fleet of plants on one grid connection and one price curve -> a single NLP over the stacked schedules
+     *
+     * x = (p_opt of unit 0; p_opt of unit 1; ...). The duration constraints of every unit are the diagonal blocks
+     * of the constraint Jacobian, followed by the (dense) coupling rows
+     *     lower <= sum_u w_u * on_u(t_j) <= upper    for every coupling time t_j
+     * where on_u(t) is the sigmoid regime activation of unit u. Unit weights limit the number of simultaneously
+     * active units, rated powers the total power drawn. The objective is the sum of the unit objectives: units are
+     * integrated and differentiated in parallel (on their own tapes) and share one PriceTable of the price curve.
+     */
+    class FleetPlant: public TNLP {
+    public:
+        std::vector<SmartPtr<Plant>> _units;
+        // Coupling constraints -> disabled without coupling times
+        vector<double> _coupling_times;
+        vector<double> _coupling_weights;  // One weight per unit
+        double _coupling_lower = 0.;
+        double _coupling_upper = 0.;
+        double _coupling_sharpness = 1.;   // Sigmoid sharpness of on_u(t)
+        size_t _threads = max_threads();
+        // Layout of x and g -> filled by prepare
+        std::vector<int> _offsets;
+        std::vector<int> _row_offsets;
+        std::shared_ptr<PriceTable> _price_table;
+        // IPOPT application status
+        int _status_init = 0;
+        int _status_solve = 0;
+        double _objective = 0.;
+        vector<double> _p_opt_ipopt;
+        vector<double> _coupling;          // Coupling row values at the solution
+
+        // Check the units, lay out x and g and share the price activations -> called before every solve
+        void prepare() {
+            if (_units.empty()) { throw std::invalid_argument("The fleet has no units"); };
+            if (_coupling_times.size() > 0 && _coupling_weights.size() != (int) _units.size()) {
+                throw std::invalid_argument("Expected one coupling weight per unit");
+            };
+            _offsets.assign(1, 0);
+            _row_offsets.assign(1, 0);
+            bool _shared = true;
+            for(const SmartPtr<Plant> &unit : _units) {
+                (*unit).check_model();
+                _offsets.push_back(_offsets.back() + (*unit)._p_opt.size());
+                _row_offsets.push_back(_row_offsets.back() + (*unit)._p_opt.size() - 1);
+                _shared = _shared && (*unit)._w_scenarios.size() == 0 &&
+                          (*unit)._p_dynamic.size() == (*_units[0])._p_dynamic.size() &&
+                          (*unit)._p_dynamic == (*_units[0])._p_dynamic;
+                (*unit).reserve_thread_tapes();
+                (*unit)._telemetry.reset(); // Per-unit counters of this solve (see eval_f, eval_grad_f)
+            };
+            _price_table = nullptr;
+            const Plant &_first = *_units[0];
+            if (_shared && _first._dt > 0.) {
+                _price_table = std::make_shared<PriceTable>(_first._t0, _first._dt,
+                                                            (int) std::floor((_first._tf - _first._t0) / _first._dt + 1e-9));
+                _price_table->filling = true;
+            };
+            for(const SmartPtr<Plant> &unit : _units) { (*unit)._price_table = _price_table; };
+        };
+        int n_vars() const { return _offsets.back(); };
+        vector<double> unit_p_opt(const Number *x, const size_t u) const {
+            return Eigen::Map<const vector<double>>(x + _offsets[u], _offsets[u + 1] - _offsets[u]);
+        };
+        // Regime activation of a unit at t (and its gradient w.r.t. the unit's switching times if grad != NULL)
+        double activation(const Number *x, const size_t u, const double t, Number *grad) const {
+            int _tmp = (_offsets[u + 1] - _offsets[u]) / 2;
+            const Number *on = x + _offsets[u];
+            const Number *off = on + _tmp;
+            double a = _coupling_sharpness;
+            double _out = 0.;
+            for(int k = 0; k < _tmp; ++k) {
+                double z_on = -a * (t - on[k]), z_off = a * (t - off[k]);
+                double s_on = 1. / (1. + cexp(z_on, sigmoid_cap));
+                double s_off = 1. / (1. + cexp(z_off, sigmoid_cap));
+                _out += s_on * s_off;
+                if (grad != NULL) {
+                    // A capped exponential is constant -> no derivative
+                    grad[k] = (z_on > sigmoid_cap) ? 0. : -a * s_on * (1. - s_on) * s_off;
+                    grad[_tmp + k] = (z_off > sigmoid_cap) ? 0. : a * s_off * (1. - s_off) * s_on;
+                };
+            };
+            return _out;
+        };
+        bool get_nlp_info(
+                Index&          n,
+                Index&          m,
+                Index&          nnz_jac_g,
+                Index&          nnz_h_lag,
+                IndexStyleEnum& index_style
+        ){
+            n = n_vars();
+            m = _row_offsets.back() + _coupling_times.size();
+            nnz_jac_g = 2 * _row_offsets.back() + _coupling_times.size() * n;
+            nnz_h_lag = 0;
+            index_style = TNLP::C_STYLE;
+            return true;
+        };
+        bool get_bounds_info(
+                Index   n,
+                Number* x_l,
+                Number* x_u,
+                Index   m,
+                Number* g_l,
+                Number* g_u
+        ){
+            for(size_t u = 0; u < _units.size(); ++u) {
+                const Plant &unit = *_units[u];
+                int _tmp = unit._p_opt.size() / 2;
+                for(int k = 0; k < 2 * _tmp; ++k) {
+                    x_l[_offsets[u] + k] = unit._lower_bound(k);
+                    x_u[_offsets[u] + k] = unit._upper_bound(k);
+                };
+                Number *_g_l = g_l + _row_offsets[u];
+                Number *_g_u = g_u + _row_offsets[u];
+                for(int k = 0; k < _tmp; ++k) { _g_l[k] = unit._on_bound(0); _g_u[k] = unit._on_bound(1); };
+                for(int k = 0; k < _tmp - 1; ++k) { _g_l[_tmp + k] = unit._off_bound(0); _g_u[_tmp + k] = unit._off_bound(1); };
+            };
+            for(int j = 0; j < _coupling_times.size(); ++j) {
+                g_l[_row_offsets.back() + j] = _coupling_lower;
+                g_u[_row_offsets.back() + j] = _coupling_upper;
+            };
+            return true;
+        };
+        bool get_starting_point(
+                Index   n,
+                bool    init_x,
+                Number* x,
+                bool    init_z,
+                Number* z_L,
+                Number* z_U,
+                Index   m,
+                bool    init_lambda,
+                Number* lambda
+        )
+        {
+            for(size_t u = 0; u < _units.size(); ++u) {
+                const vector<double> &_p_opt = (*_units[u])._p_opt;
+                for(int k = 0; k < _p_opt.size(); ++k) { x[_offsets[u] + k] = _p_opt(k); };
+            };
+            return true;
+        };
+        bool eval_f(
+                Index         n,
+                const Number* x,
+                bool          new_x,
+                Number&       obj_value
+        )
+        {
+            TRACE_SCOPE("fleet_eval_f", "callback");
+            std::vector<double> _values(_units.size(), 0.);
+            auto _unit = [&] (size_t u, size_t thread) {
+                Plant &unit = *_units[u];
+                STATS_ADD(unit._telemetry, eval_f_calls, 1);
+                STATS_TIMER(unit._telemetry, eval_f_seconds);
+                _values[u] = unit.objective_wrapper(unit_p_opt(x, u));
+            };
+            if (_price_table && _price_table->filling) {
+                // First evaluation fills the shared price activations -> sequential, read-only afterwards
+                for(size_t u = 0; u < _units.size(); ++u) { _unit(u, thread_number()); };
+                _price_table->filling = false;
+            } else {
+                parallel_for(_units.size(), _threads, _unit);
+            };
+            obj_value = 0.;
+            for(double _value : _values) { obj_value += _value; };
+            return true;
+        };
+        bool eval_grad_f(
+                Index         n,
+                const Number* x,
+                bool          new_x,
+                Number*       grad_f
+        )
+        {
+            TRACE_SCOPE("fleet_eval_grad_f", "callback");
+            // Tapes and their dynamical parameters are updated in sequential mode, the sweeps run in parallel on
+            // per-thread tape copies, which load new dynamical parameters only after a change
+            for(size_t u = 0; u < _units.size(); ++u) {
+                Plant &unit = *_units[u];
+                unit.record_tape(unit_p_opt(x, u));
+                unit.update_dynamic();
+            };
+            parallel_for(_units.size(), _threads, [&] (size_t u, size_t thread) {
+                Plant &unit = *_units[u];
+                STATS_ADD(unit._telemetry, eval_grad_f_calls, 1);
+                STATS_TIMER(unit._telemetry, eval_grad_f_seconds);
+                vector<double> _p_opt = unit_p_opt(x, u);
+                vector<double> _grad;
+                if (unit._w_scenarios.size() > 0) {
+                    _grad = unit.scenario_jacobian(_p_opt);
+                } else {
+                    _grad = unit.dynamic_thread_tape(thread).Jacobian(_p_opt);
+                };
+                for(int k = 0; k < _grad.size(); ++k) { grad_f[_offsets[u] + k] = _grad(k); };
+            });
+            return true;
+        };
+        bool eval_g(
+                Index         n,
+                const Number* x,
+                bool          new_x,
+                Index         m,
+                Number*       g
+        )
+        {
+            for(size_t u = 0; u < _units.size(); ++u) {
+                int _tmp = (_offsets[u + 1] - _offsets[u]) / 2;
+                const Number *_x = x + _offsets[u];
+                Number *_g = g + _row_offsets[u];
+                for(int k = 0; k < _tmp; ++k) { _g[k] = _x[_tmp + k] - _x[k]; };
+                for(int k = 0; k < _tmp - 1; ++k) { _g[_tmp + k] = _x[k + 1] - _x[_tmp + k]; };
+            };
+            for(int j = 0; j < _coupling_times.size(); ++j) {
+                double _sum = 0.;
+                for(size_t u = 0; u < _units.size(); ++u) {
+                    _sum += _coupling_weights(u) * activation(x, u, _coupling_times(j), NULL);
+                };
+                g[_row_offsets.back() + j] = _sum;
+            };
+            return true;
+        };
+        bool eval_jac_g(
+                Index         n,
+                const Number* x,
+                bool          new_x,
+                Index         m,
+                Index         nele_jac,
+                Index*        iRow,
+                Index*        jCol,
+                Number*       values
+        )
+        {
+            int _count = 0;
+            if( values == NULL )
+            {
+                // Unit blocks -> same pattern as Plant::eval_jac_g, shifted by the unit offsets
+                for(size_t u = 0; u < _units.size(); ++u) {
+                    int _tmp = (_offsets[u + 1] - _offsets[u]) / 2;
+                    int _row = _row_offsets[u], _col = _offsets[u];
+                    for(int k = 0; k < _tmp; ++k) {
+                        iRow[_count] = _row + k; jCol[_count] = _col + k;
+                        _count += 1;
+                        iRow[_count] = _row + k; jCol[_count] = _col + _tmp + k;
+                        _count += 1;
+                    };
+                    for(int k = 0; k < _tmp - 1; ++k) {
+                        iRow[_count] = _row + _tmp + k; jCol[_count] = _col + k + 1;
+                        _count += 1;
+                        iRow[_count] = _row + _tmp + k; jCol[_count] = _col + _tmp + k;
+                        _count += 1;
+                    };
+                };
+                for(int j = 0; j < _coupling_times.size(); ++j) {
+                    for(int k = 0; k < n; ++k) {
+                        iRow[_count] = _row_offsets.back() + j; jCol[_count] = k;
+                        _count += 1;
+                    };
+                };
+            }
+            else
+            {
+                for(size_t u = 0; u < _units.size(); ++u) {
+                    int _tmp = (_offsets[u + 1] - _offsets[u]) / 2;
+                    for(int k = 0; k < _tmp; ++k) {
+                        values[_count] = -1.;
+                        _count += 1;
+                        values[_count] = 1.;
+                        _count += 1;
+                    };
+                    for(int k = 0; k < _tmp - 1; ++k) {
+                        values[_count] = 1.;
+                        _count += 1;
+                        values[_count] = -1.;
+                        _count += 1;
+                    };
+                };
+                for(int j = 0; j < _coupling_times.size(); ++j) {
+                    for(size_t u = 0; u < _units.size(); ++u) {
+                        activation(x, u, _coupling_times(j), values + _count + _offsets[u]);
+                        for(int k = _offsets[u]; k < _offsets[u + 1]; ++k) { values[_count + k] *= _coupling_weights(u); };
+                    };
+                    _count += n;
+                };
+            };
+            return true;
+        };
+        bool eval_h(
+                Index         n,
+                const Number* x,
+                bool          new_x,
+                Number        obj_factor,
+                Index         m,
+                const Number* lambda,
+                bool          new_lambda,
+                Index         nele_hess,
+                Index*        iRow,
+                Index*        jCol,
+                Number*       values
+        )
+        {
+            return true;
+        };
+        void finalize_solution(
+                SolverReturn               status,
+                Index                      n,
+                const Number*              x,
+                const Number*              z_L,
+                const Number*              z_U,
+                Index                      m,
+                const Number*              g,
+                const Number*              lambda,
+                Number                     obj_value,
+                const IpoptData*           ip_data,
+                IpoptCalculatedQuantities* ip_cq
+        )
+        {
+            _objective = obj_value;
+            _p_opt_ipopt = Eigen::Map<const vector<double>>(x, n);
+            _coupling = Eigen::Map<const vector<double>>(g + _row_offsets.back(), _coupling_times.size());
+            // Hand the unit schedules back to the plants -> plant.get_p_optimize_ipopt() and get_objective() work
+            parallel_for(_units.size(), _threads, [&] (size_t u, size_t thread) {
+                Plant &unit = *_units[u];
+                unit._p_opt_ipopt = unit_p_opt(x, u);
+                unit._objective = unit.objective_wrapper(unit._p_opt_ipopt);
+            });
+        };
+    };
+    class Fleet {
+    public:
+        SmartPtr<FleetPlant> fleet;
+        int _print_level = 0;
+        Fleet() { fleet = new FleetPlant(); };
+        // Set functions
+        void add(const NLP &nlp) { (*fleet)._units.push_back(nlp.plant); };
+        void set_p_dynamic(const vector_ref<double> &p_dynamic) {
+            for(SmartPtr<Plant> &unit : (*fleet)._units) { (*unit).set_p_dynamic(p_dynamic); };
+        };
+        void set_coupling(const vector_ref<double> &times, const vector_ref<double> &weights, const double lower,
+                          const double upper, const double sharpness) {
+            (*fleet)._coupling_times = times;
+            (*fleet)._coupling_weights = weights;
+            (*fleet)._coupling_lower = lower;
+            (*fleet)._coupling_upper = upper;
+            (*fleet)._coupling_sharpness = sharpness;
+        };
+        void clear_coupling() {
+            (*fleet)._coupling_times.resize(0);
+            (*fleet)._coupling_weights.resize(0);
+        };
+        void set_threads(const size_t threads) { (*fleet)._threads = threads; };
+        void set_print_level(const int print_level) { _print_level = print_level; };
+        // Get functions
+        size_t size() const { return (*fleet)._units.size(); };
+        const vector<double> &get_p_optimize_ipopt() const { return (*fleet)._p_opt_ipopt; };
+        const vector<double> &get_coupling() const { return (*fleet)._coupling; };
+        const double &get_objective() const { return (*fleet)._objective; };
+        const int &get_init_status() const { return (*fleet)._status_init; };
+        const int &get_solve_status() const { return (*fleet)._status_solve; };
+        // Solver wrapper
+        void solve() {
+            TRACE_SCOPE("fleet_solve", "solve");
+            (*fleet).prepare();
+            SmartPtr<IpoptApplication> app = ipopt_application(_print_level);
+            (*fleet)._status_init = (int) app->Initialize();
+            (*fleet)._status_solve = (int) app->OptimizeTNLP(fleet);
+            // The units share the fleet's ApplicationReturnStatus -> same meaning as after NLP::solve
+            for(SmartPtr<Plant> &unit : (*fleet)._units) {
+                (*unit)._status_init = (*fleet)._status_init;
+                (*unit)._status_solve = (*fleet)._status_solve;
+            };
+        };
+    };
+}
+
+#endif //SWITCHINGTIMES_SWITCHING_TIMES_FLEET_HPP
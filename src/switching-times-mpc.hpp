@@ -0,0 +1,159 @@
+#ifndef SWITCHINGTIMES_SWITCHING_TIMES_MPC_HPP
+#define SWITCHINGTIMES_SWITCHING_TIMES_MPC_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "switching-times.hpp"
+
+namespace SwitchingTimes {
+    /*
+     * Receding-horizon (MPC) driver built on the NLP of a configured plant
+     *
+     * Every step solves the current window, applies the first _shift minutes of the optimal schedule, obtains the
+     * next initial state from Plant::integrate and advances the window. The plant works in window-relative time
+     * (its _t0/_tf are left untouched), so only p_dynamic (prices and window-relative price times), x0 and the
+     * warm start change between steps -> sizes stay fixed. The price interval index is recorded on the tape (see
+     * PriceIndex), so the tape is only reused through new_dynamic while the window-relative price times repeat,
+     * i.e. for shifts by whole intervals of a uniform curve. Shifts that do not line up with a uniform curve are
+     * rejected; on a non-uniform curve every step with new window-relative price times records a new tape.
+     * A failed solve is not applied: the step is recorded with applied = false and the window stays where it is.
+     */
+    class RecedingHorizon {
+    public:
+        struct Step {
+            double time;           // Absolute time of the window start
+            vector<double> x0;     // Initial state of the window
+            vector<double> p_opt;  // Optimal schedule (window-relative)
+            double objective;
+            int status;
+            double seconds;        // Wall time of the solve
+            bool retaped;          // Whether the objective tape was recorded (new window-relative price times)
+            bool applied;          // Whether the schedule was applied (false after a failed solve)
+        };
+        NLP &_nlp;
+        vector<double> _prices; // Full price curve -> one price per interval
+        vector<double> _times;  // Full price interval boundaries (absolute) -> _prices.size() + 1 entries
+        double _shift;          // Applied part of each solution (e.g. one price interval)
+        double _time;           // Absolute time of the current window start
+        vector<double> _x;      // Initial state of the current window
+        vector<double> _warm;   // Warm start of the current window
+        int _print_level = 0;
+        std::vector<Step> _steps;
+
+        RecedingHorizon(NLP &nlp, const vector<double> &prices, const vector<double> &times, const double shift,
+                        const double time) :
+                _nlp(nlp), _prices(prices), _times(times), _shift(shift), _time(time) {
+            if (prices.size() == 0) { throw std::invalid_argument("Expected at least one price"); };
+            if (times.size() != prices.size() + 1) {
+                throw std::invalid_argument("Expected one more price time than prices");
+            };
+            if (!(shift > 0.)) { throw std::invalid_argument("Expected a positive shift"); };
+            // Uniform curve -> the shift must be whole intervals, otherwise every step would retape
+            double _h = times(1) - times(0);
+            bool _uniform = _h > 0.;
+            for(int k = 1; k < prices.size() && _uniform; ++k) {
+                _uniform = std::abs(times(k + 1) - times(k) - _h) <= 1e-9 * _h;
+            };
+            if (_uniform && std::abs(shift / _h - std::round(shift / _h)) > 1e-9 * (shift / _h)) {
+                throw std::invalid_argument("The shift must be a multiple of the price interval length (" +
+                                            std::to_string(_h) + ") -> the tape is reused only for aligned shifts");
+            };
+            _x = (*_nlp.plant)._x0;
+            _warm = (*_nlp.plant)._p_opt;
+        };
+        Step step() {
+            TRACE_SCOPE("mpc_step", "mpc");
+            Plant &_plant = *_nlp.plant;
+            _plant.set_p_dynamic(window());
+            _plant.set_x0(_x);
+            _plant.set_p_optimize(_warm);
+            size_t _version = _plant.tape_version;
+            auto _start = std::chrono::steady_clock::now();
+            _nlp.solve_plant(_nlp.plant, _print_level, _nlp.lbfgsb);
+            std::chrono::duration<double> _elapsed = std::chrono::steady_clock::now() - _start;
+            bool _applied = usable(_plant._status_solve);
+            Step _out{_time, _x, _plant._p_opt_ipopt, _plant._objective, _plant._status_solve,
+                      _elapsed.count(), _plant.tape_version != _version, _applied};
+            if (!_applied) {
+                // Keep state, window and warm start -> the caller decides how to recover
+                _steps.push_back(_out);
+                return _out;
+            };
+            // Apply the first part of the schedule -> integrate uses the plant's p_opt
+            _plant._p_opt = _plant._p_opt_ipopt;
+            _x = _plant.integrate(_plant._t0, _plant._t0 + _shift, _plant._dt, _x);
+            _time += _shift;
+            _warm = shifted(_plant._p_opt_ipopt);
+            _steps.push_back(_out);
+            return _out;
+        };
+        // Stops after the first failed step
+        std::vector<Step> run(const int n_steps) {
+            std::vector<Step> _out;
+            for(int k = 0; k < n_steps; ++k) {
+                _out.push_back(step());
+                if (!_out.back().applied) { break; };
+            };
+            return _out;
+        };
+        const std::vector<Step> &get_steps() const { return _steps; };
+        const vector<double> &get_x() const { return _x; };
+        const double &get_time() const { return _time; };
+
+    private:
+        // Solve statuses with a usable schedule -> ApplicationReturnStatus Solve_Succeeded,
+        // Solved_To_Acceptable_Level, User_Requested_Stop (callback or stall) and Feasible_Point_Found
+        static bool usable(const int status) { return status == 0 || status == 1 || status == 5 || status == 6; };
+        // p_dynamic of the current window -> (prices; window-relative price times) in the layout of Plant::model
+        vector<double> window() const {
+            const Plant &_plant = *_nlp.plant;
+            int n_window = (_plant._p_dynamic.size() - 1) / 2;
+            int n_prices = _prices.size();
+            int i0 = std::upper_bound(_times.data(), _times.data() + _times.size(), _time) - _times.data() - 1;
+            i0 = std::max(0, std::min(i0, n_prices - 1));
+            double _last = _times(n_prices) - _times(n_prices - 1);
+            vector<double> _out = vector<double>::Zero(_plant._p_dynamic.size());
+            for(int k = 0; k < n_window; ++k) { _out(k) = _prices(std::min(i0 + k, n_prices - 1)); };
+            for(int k = 0; k <= n_window; ++k) {
+                // Beyond the end of the curve the last price is held on intervals of the last length
+                double _t = (i0 + k <= n_prices) ? _times(i0 + k) : _times(n_prices) + (i0 + k - n_prices) * _last;
+                _out(n_window + k) = _t - _time + _plant._t0;
+            };
+            return _out;
+        };
+        /*
+         * Warm start for the next window -> shift the schedule by _shift and restore the duration constraints with
+         * a forward pass. Switch pairs that are entirely in the past are recycled at the end of the schedule.
+         */
+        vector<double> shifted(const vector<double> &p_opt) const {
+            const Plant &_plant = *_nlp.plant;
+            int _tmp = p_opt.size() / 2;
+            std::vector<std::pair<double, double>> _pairs, _past;
+            for(int k = 0; k < _tmp; ++k) {
+                std::pair<double, double> _pair(p_opt(k) - _shift, p_opt(_tmp + k) - _shift);
+                if (_pair.second <= _plant._t0) { _past.push_back(_pair); } else { _pairs.push_back(_pair); };
+            };
+            double on_min = _plant._on_bound(0), on_max = _plant._on_bound(1);
+            double off_min = _plant._off_bound(0), off_max = _plant._off_bound(1);
+            for(size_t k = 0; k < _past.size(); ++k) {
+                double _on = _pairs.empty() ? _plant._t0 : _pairs.back().second + off_min;
+                _pairs.emplace_back(_on, _on + on_min);
+            };
+            vector<double> _out = vector<double>::Zero(p_opt.size());
+            for(int k = 0; k < _tmp; ++k) {
+                double _on = std::max(_pairs[k].first, _plant._lower_bound(k));
+                if (k > 0) { _on = std::min(std::max(_on, _out(_tmp + k - 1) + off_min), _out(_tmp + k - 1) + off_max); };
+                double _off = std::min(std::max(_pairs[k].second, _on + on_min), _on + on_max);
+                _out(k) = std::min(_on, _plant._upper_bound(k));
+                _out(_tmp + k) = std::min(_off, _plant._upper_bound(_tmp + k));
+            };
+            return _out;
+        };
+    };
+}
+
+#endif //SWITCHINGTIMES_SWITCHING_TIMES_MPC_HPP
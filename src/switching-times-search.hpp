@@ -0,0 +1,220 @@
+#ifndef SWITCHINGTIMES_SWITCHING_TIMES_SEARCH_HPP
+#define SWITCHINGTIMES_SWITCHING_TIMES_SEARCH_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <stdexcept>
+#include <vector>
+#include "parallel.hpp"
+#include "switching-times.hpp"
+
+namespace SwitchingTimes {
+    /*
+     * Search over the number of switches n_s
+     *
+     * Starting from the schedule of the NLP, every round proposes schedules with one switch pair more (split an
+     * ON or OFF interval of the current optimum) or less (merge two ON intervals or drop one), warm-started from
+     * the current optimum. Candidates are solved in parallel on plants kept per size, so each size is taped once.
+     * The variable bounds of the base plant move with the switch times: an inserted pair gets the bounds of the
+     * interval it splits (lower bound of its start, upper bound of its end), a dropped pair takes its bounds along.
+     * The search stops when no candidate improves the cost; the result is the lowest cost schedule, where
+     * schedules within the relative tolerance of it are resolved in favour of fewer switches.
+     */
+    class SwitchSearch {
+    public:
+        struct Candidate {
+            int n_s;
+            vector<double> p_opt;
+            vector<double> lower_bound;  // Variable bounds of the schedule (see above)
+            vector<double> upper_bound;
+            double objective;
+            int status;
+            bool feasible;
+        };
+        NLP &_nlp;
+        int _max_rounds = 10;     // Maximum number of split/merge rounds
+        int _max_candidates = 8;  // Maximum number of candidates per round
+        size_t _threads = max_threads();
+        double _rel_tol = 1e-4;   // Relative cost improvement required to change n_s
+        double _feas_tol = 1e-3;  // Constraint violation tolerance of a usable solution
+        // Plants per size -> tapes (and their size) are kept between rounds and runs
+        std::map<int, std::vector<SmartPtr<Plant>>> _plants;
+        std::vector<Candidate> _history;
+
+        SwitchSearch(NLP &nlp) : _nlp(nlp) {};
+
+        Candidate run() {
+            const Plant &_base = *_nlp.plant;
+            if (_base._lower_bound.size() != _base._p_opt.size() || _base._upper_bound.size() != _base._p_opt.size()) {
+                throw std::invalid_argument("The variable bounds must have the size of p_optimize");
+            };
+            _history.clear();
+            std::vector<Schedule> _start(1, Schedule{_base._p_opt, _base._lower_bound, _base._upper_bound});
+            Candidate best = evaluate(_start)[0];
+            _history.push_back(best);
+            for(int round = 0; round < _max_rounds; ++round) {
+                std::vector<Schedule> _schedules = propose(best);
+                if (_schedules.empty()) { break; };
+                std::vector<Candidate> _results = evaluate(_schedules);
+                _history.insert(_history.end(), _results.begin(), _results.end());
+                const Candidate *_round_best = nullptr;
+                for(const Candidate &c : _results) {
+                    if (c.feasible && (_round_best == nullptr || c.objective < _round_best->objective)) { _round_best = &c; };
+                };
+                if (_round_best == nullptr ||
+                    !(_round_best->objective < best.objective - _rel_tol * std::abs(best.objective))) { break; };
+                best = *_round_best;
+            };
+            return select();
+        };
+        const std::vector<Candidate> &get_history() const { return _history; };
+
+    private:
+        // Starting point and variable bounds of a candidate
+        struct Schedule {
+            vector<double> p_opt;
+            vector<double> lower_bound;
+            vector<double> upper_bound;
+        };
+        // Lowest cost -> ties (within _rel_tol) go to the smaller number of switches
+        Candidate select() const {
+            const Candidate *_min = &_history[0];
+            for(const Candidate &c : _history) {
+                if (c.feasible && (!_min->feasible || c.objective < _min->objective)) { _min = &c; };
+            };
+            const Candidate *_out = _min;
+            for(const Candidate &c : _history) {
+                if (c.feasible && c.n_s < _out->n_s &&
+                    c.objective <= _min->objective + _rel_tol * std::abs(_min->objective)) { _out = &c; };
+            };
+            return *_out;
+        };
+        // Schedule in temporal order (ON_1, OFF_1, ON_2, ...) and back
+        static std::vector<double> to_sequence(const vector<double> &p_opt) {
+            int _tmp = p_opt.size() / 2;
+            std::vector<double> _seq(p_opt.size());
+            for(int k = 0; k < _tmp; ++k) { _seq[2 * k] = p_opt(k); _seq[2 * k + 1] = p_opt(_tmp + k); };
+            return _seq;
+        };
+        static vector<double> from_sequence(const std::vector<double> &seq) {
+            int _tmp = seq.size() / 2;
+            vector<double> _p_opt = vector<double>::Zero(seq.size());
+            for(int k = 0; k < _tmp; ++k) { _p_opt(k) = seq[2 * k]; _p_opt(_tmp + k) = seq[2 * k + 1]; };
+            return _p_opt;
+        };
+        std::vector<Schedule> propose(const Candidate &current) const {
+            const Plant &_base = *_nlp.plant;
+            double on_min = _base._on_bound(0), on_max = _base._on_bound(1);
+            double off_min = _base._off_bound(0), off_max = _base._off_bound(1);
+            std::vector<double> _seq = to_sequence(current.p_opt);
+            std::vector<double> _lo = to_sequence(current.lower_bound), _hi = to_sequence(current.upper_bound);
+            int n = _seq.size();
+            // Insert the pair (a, b) after position k -> bounds of the interval [k, k + 1] it splits
+            auto split = [&] (int k, double a, double b) {
+                std::vector<double> _s(_seq), _l(_lo), _h(_hi);
+                _s.insert(_s.begin() + k + 1, {a, b});
+                _l.insert(_l.begin() + k + 1, {_lo[k], _lo[k]});
+                _h.insert(_h.begin() + k + 1, {_hi[k + 1], _hi[k + 1]});
+                return Schedule{from_sequence(_s), from_sequence(_l), from_sequence(_h)};
+            };
+            // Drop the pair at positions k, k + 1 together with its bounds
+            auto merge = [&] (int k) {
+                std::vector<double> _s(_seq), _l(_lo), _h(_hi);
+                _s.erase(_s.begin() + k, _s.begin() + k + 2);
+                _l.erase(_l.begin() + k, _l.begin() + k + 2);
+                _h.erase(_h.begin() + k, _h.begin() + k + 2);
+                return Schedule{from_sequence(_s), from_sequence(_l), from_sequence(_h)};
+            };
+            // (priority, schedule) -> splits of long intervals and merges of short intervals first
+            std::vector<std::pair<double, Schedule>> _splits, _merges;
+            for(int k = 0; k < n - 1; ++k) {
+                double _a = _seq[k], _b = _seq[k + 1], _len = _b - _a;
+                if (k % 2 == 0 && _len >= 2. * on_min + off_min) {
+                    // Split ON interval -> insert an OFF period in the middle
+                    double _m = _a + 0.5 * (_len - off_min);
+                    _splits.emplace_back(_len, split(k, _m, _m + off_min));
+                };
+                if (k % 2 == 1 && _len >= on_min + 2. * off_min) {
+                    // Split OFF interval -> insert an ON period in the middle
+                    double _m = _a + 0.5 * (_len - on_min);
+                    _splits.emplace_back(_len, split(k, _m, _m + on_min));
+                };
+                if (n > 2 && k % 2 == 1 && _seq[k + 2] - _seq[k - 1] <= on_max) {
+                    // Merge ON intervals -> drop the OFF period in between
+                    _merges.emplace_back(_len, merge(k));
+                };
+                if (n > 2 && k % 2 == 0 && (k == 0 || k + 2 >= n || _seq[k + 2] - _seq[k - 1] <= off_max)) {
+                    // Drop ON interval
+                    _merges.emplace_back(_len, merge(k));
+                };
+            };
+            std::sort(_splits.begin(), _splits.end(), [] (const auto &a, const auto &b) { return a.first > b.first; });
+            std::sort(_merges.begin(), _merges.end(), [] (const auto &a, const auto &b) { return a.first < b.first; });
+            std::vector<Schedule> _out;
+            for(size_t k = 0; (int) _out.size() < _max_candidates && k < std::max(_splits.size(), _merges.size()); ++k) {
+                if (k < _splits.size()) { _out.push_back(_splits[k].second); };
+                if (k < _merges.size() && (int) _out.size() < _max_candidates) { _out.push_back(_merges[k].second); };
+            };
+            return _out;
+        };
+        bool feasible(const vector<double> &p_opt, const Schedule &schedule) const {
+            const Plant &_base = *_nlp.plant;
+            if (((p_opt - schedule.lower_bound).array() < -_feas_tol).any() ||
+                ((p_opt - schedule.upper_bound).array() > _feas_tol).any()) { return false; };
+            std::vector<double> _seq = to_sequence(p_opt);
+            for(size_t k = 0; k + 1 < _seq.size(); ++k) {
+                const vector<double> &_bound = (k % 2 == 0) ? _base._on_bound : _base._off_bound;
+                double _len = _seq[k + 1] - _seq[k];
+                if (_len < _bound(0) - _feas_tol || _len > _bound(1) + _feas_tol) { return false; };
+            };
+            return true;
+        };
+        /*
+         * Plant of a given size (slot within the size pool) configured as the base plant -> slot 0 records the tape
+         * of the size, later slots take it over (called in slot order, outside of parallel regions)
+         */
+        SmartPtr<Plant> plant_for(const Schedule &schedule, size_t slot) {
+            const Plant &_base = *_nlp.plant;
+            const vector<double> &p_opt = schedule.p_opt;
+            int n_opt = p_opt.size();
+            std::vector<SmartPtr<Plant>> &_pool = _plants[n_opt];
+            while (_pool.size() <= slot) { _pool.push_back(new Plant()); };
+            SmartPtr<Plant> _plant = _pool[slot];
+            (*_plant).set_p_optimize(p_opt);
+            (*_plant).copy_configuration(_base);
+            if (_base._w_scenarios.size() > 0) {
+                (*_plant).set_scenarios(_base._p_scenarios, _base._w_scenarios);
+            } else if ((*_plant)._w_scenarios.size() > 0) {
+                (*_plant).clear_scenarios();
+            };
+            (*_plant).set_lower_bound(schedule.lower_bound);
+            (*_plant).set_upper_bound(schedule.upper_bound);
+            if ((*_plant).new_tape) {
+                if (slot == 0) { (*_plant).record_tape(p_opt); } else { (*_plant).share_tape(*_pool[0]); };
+            };
+            return _plant;
+        };
+        std::vector<Candidate> evaluate(const std::vector<Schedule> &schedules) {
+            // Assign plants sequentially -> the parallel region only touches its own plant
+            std::map<int, size_t> _used;
+            std::vector<SmartPtr<Plant>> _assigned;
+            for(const Schedule &schedule : schedules) {
+                _assigned.push_back(plant_for(schedule, _used[schedule.p_opt.size()]++));
+            };
+            std::vector<Candidate> _out(schedules.size());
+            parallel_for(schedules.size(), _threads, [&] (size_t k, size_t thread) {
+                Plant &_plant = *_assigned[k];
+                const Schedule &_schedule = schedules[k];
+                _plant.set_p_optimize(_schedule.p_opt);
+                _nlp.solve_plant(_assigned[k], 0);
+                _out[k] = Candidate{(int) _schedule.p_opt.size() / 2, _plant._p_opt_ipopt, _schedule.lower_bound,
+                                    _schedule.upper_bound, _plant._objective, _plant._status_solve,
+                                    feasible(_plant._p_opt_ipopt, _schedule)};
+            });
+            return _out;
+        };
+    };
+}
+
+#endif //SWITCHINGTIMES_SWITCHING_TIMES_SEARCH_HPP
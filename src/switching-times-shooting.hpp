@@ -0,0 +1,392 @@
+#ifndef SWITCHINGTIMES_SWITCHING_TIMES_SHOOTING_HPP
+#define SWITCHINGTIMES_SWITCHING_TIMES_SHOOTING_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include "parallel.hpp"
+#include "switching-times.hpp"
+
+namespace SwitchingTimes {
+    /*
+     * Multiple-shooting formulation of a configured plant
+     *
+     * The integration grid t0 + k * dt is split into _segments segments of (about) equal step counts, so the
+     * segments reproduce the single-shooting integration exactly. The initial states s_1, ..., s_{M-1} of all but
+     * the first segment become decision variables:
+     *     x = (p_opt; s_1; ...; s_{M-1})
+     *     g = (duration constraints of the plant; F_0(x0, p_opt) - s_1; ...; F_{M-2}(s_{M-2}, p_opt) - s_{M-1}) with
+     *         the continuity rows fixed at 0
+     *     f = cost(F_{M-1}(s_{M-1}, p_opt))
+     * where F_i integrates segment i. Every segment has its own tape (inputs p_opt and s_i, dynamical parameters as
+     * in Plant::dynamic_parameters), segments are integrated and differentiated in parallel on per-thread copies.
+     */
+    class ShootingPlant: public TNLP {
+    public:
+        SmartPtr<Plant> _plant;
+        int _segments = 4;
+        size_t _threads = max_threads();
+        // IPOPT application status
+        int _status_init = 0;
+        int _status_solve = 0;
+        double _objective = 0.;
+        vector<double> _z_opt;  // Solution (p_opt; s_1; ...; s_{M-1})
+        matrix<double> _states; // Initial state of every segment at the solution -> one row per segment
+
+        // Split the grid and record the segment tapes -> called before every solve
+        void prepare() {
+            Plant &plant = *_plant;
+            plant.check_model();
+            if (_segments < 1) { throw std::invalid_argument("Expected at least one segment"); };
+            if (!(plant._dt > 0.)) { throw std::invalid_argument("Expected dt > 0"); };
+            if (plant._w_scenarios.size() > 0) {
+                throw std::invalid_argument("Multiple shooting does not support scenarios -> clear them first");
+            };
+            _n_p = plant._p_opt.size();
+            _n_x = plant._x0.size();
+            // Step count of integrate_const in Plant::objective_wrapper (same end-of-horizon test as odeint)
+            int n_steps = 0;
+            while (plant._t0 + n_steps * plant._dt + plant._dt - plant._tf <= std::numeric_limits<double>::epsilon()) {
+                n_steps += 1;
+            };
+            int n_segments = std::max(1, std::min(_segments, n_steps));
+            _first.assign(n_segments + 1, 0);
+            for(int i = 0; i <= n_segments; ++i) { _first[i] = (int) ((long) n_steps * i / n_segments); };
+            _dynamic = plant.dynamic_parameters(plant._p_dynamic);
+            _window = plant.sharpness_floor();
+            // Starting point -> segment states of the single-shooting trajectory of the current schedule
+            _start = vector<double>::Zero(n_z());
+            _start.head(_n_p) = plant._p_opt;
+            vector<double> _x = plant._x0;
+            for(int i = 0; i + 1 < n_segments; ++i) {
+                _x = segment<double>(i, _dynamic, plant._p_opt, _x).head(_n_x);
+                _start.segment(state_offset(i + 1), _n_x) = _x;
+            };
+            // Record the segment tapes in sequential mode
+            TRACE_SCOPE("record_tape", "tape");
+            _tapes.resize(n_segments);
+            for(int i = 0; i < n_segments; ++i) {
+                vector<ad_double> _u = vector<ad_double>::Zero(_n_p + _n_x);
+                for(int k = 0; k < _n_p; ++k) { _u(k) = plant._p_opt(k); };
+                for(int k = 0; k < _n_x; ++k) { _u(_n_p + k) = segment_input(_start, i)(k); };
+                vector<ad_double> _dyn = _dynamic.cast<ad_double>();
+                size_t abort_op_index = 0;
+                bool record_compare = true;
+                CppAD::Independent(_u, abort_op_index, record_compare, _dyn);
+                vector<ad_double> _p_opt = _u.head(_n_p);
+                vector<ad_double> _out = segment<ad_double>(i, _dyn, _p_opt, _u.tail(_n_x));
+                _tapes[i] = ad_function(_u, _out);
+            };
+            _version += 1;
+            _copies.resize(max_threads());
+            _copy_version.resize(max_threads());
+            for(size_t k = 0; k < _copies.size(); ++k) {
+                _copies[k].resize(n_segments);
+                _copy_version[k].resize(n_segments, 0);
+            };
+            _values_at.resize(0);
+            _jacobian_at.resize(0);
+        };
+        int n_segments() const { return _first.size() - 1; };
+        int n_z() const { return _n_p + (n_segments() - 1) * _n_x; };
+        int n_duration() const { return std::max(0, _n_p - 1); };
+
+        bool get_nlp_info(
+                Index&          n,
+                Index&          m,
+                Index&          nnz_jac_g,
+                Index&          nnz_h_lag,
+                IndexStyleEnum& index_style
+        ){
+            n = n_z();
+            m = n_duration() + (n_segments() - 1) * _n_x;
+            nnz_jac_g = 2 * n_duration();
+            for(int i = 0; i + 1 < n_segments(); ++i) { nnz_jac_g += _n_x * (_n_p + (i > 0 ? _n_x : 0) + 1); };
+            nnz_h_lag = 0;
+            index_style = TNLP::C_STYLE;
+            return true;
+        };
+        bool get_bounds_info(
+                Index   n,
+                Number* x_l,
+                Number* x_u,
+                Index   m,
+                Number* g_l,
+                Number* g_u
+        ){
+            const Plant &plant = *_plant;
+            for(int k = 0; k < _n_p; ++k) { x_l[k] = plant._lower_bound(k); x_u[k] = plant._upper_bound(k); };
+            for(int k = _n_p; k < n; ++k) { x_l[k] = -2e19; x_u[k] = 2e19; };
+            int _tmp = _n_p / 2;
+            for(int k = 0; k < _tmp; ++k) { g_l[k] = plant._on_bound(0); g_u[k] = plant._on_bound(1); };
+            for(int k = 0; k < _tmp - 1; ++k) { g_l[_tmp + k] = plant._off_bound(0); g_u[_tmp + k] = plant._off_bound(1); };
+            for(int k = n_duration(); k < m; ++k) { g_l[k] = 0.; g_u[k] = 0.; };
+            return true;
+        };
+        bool get_starting_point(
+                Index   n,
+                bool    init_x,
+                Number* x,
+                bool    init_z,
+                Number* z_L,
+                Number* z_U,
+                Index   m,
+                bool    init_lambda,
+                Number* lambda
+        ){
+            for(int k = 0; k < n; ++k) { x[k] = _start(k); };
+            return true;
+        };
+        bool eval_f(
+                Index         n,
+                const Number* x,
+                bool          new_x,
+                Number&       obj_value
+        )
+        {
+            TRACE_SCOPE("shooting_eval_f", "callback");
+            evaluate(x);
+            obj_value = _values[n_segments() - 1](_n_x);
+            return true;
+        };
+        bool eval_grad_f(
+                Index         n,
+                const Number* x,
+                bool          new_x,
+                Number*       grad_f
+        )
+        {
+            TRACE_SCOPE("shooting_eval_grad_f", "callback");
+            differentiate(x);
+            int i = n_segments() - 1;
+            const vector<double> &_jac = _jacobians[i];
+            int _cols = _n_p + _n_x;
+            for(int k = 0; k < n; ++k) { grad_f[k] = 0.; };
+            for(int k = 0; k < _n_p; ++k) { grad_f[k] = _jac(_n_x * _cols + k); };
+            if (i > 0) {
+                for(int k = 0; k < _n_x; ++k) { grad_f[state_offset(i) + k] = _jac(_n_x * _cols + _n_p + k); };
+            };
+            return true;
+        };
+        bool eval_g(
+                Index         n,
+                const Number* x,
+                bool          new_x,
+                Index         m,
+                Number*       g
+        )
+        {
+            int _tmp = _n_p / 2;
+            for(int k = 0; k < _tmp; ++k) { g[k] = x[_tmp + k] - x[k]; };
+            for(int k = 0; k < _tmp - 1; ++k) { g[_tmp + k] = x[k + 1] - x[_tmp + k]; };
+            evaluate(x);
+            for(int i = 0; i + 1 < n_segments(); ++i) {
+                for(int a = 0; a < _n_x; ++a) {
+                    g[n_duration() + i * _n_x + a] = _values[i](a) - x[state_offset(i + 1) + a];
+                };
+            };
+            return true;
+        };
+        bool eval_jac_g(
+                Index         n,
+                const Number* x,
+                bool          new_x,
+                Index         m,
+                Index         nele_jac,
+                Index*        iRow,
+                Index*        jCol,
+                Number*       values
+        )
+        {
+            int _count = 0;
+            int _tmp = _n_p / 2;
+            int _cols = _n_p + _n_x;
+            if( values == NULL )
+            {
+                // Duration rows -> as Plant::eval_jac_g
+                for(int k = 0; k < _tmp; ++k) {
+                    iRow[_count] = k; jCol[_count] = k; _count += 1;
+                    iRow[_count] = k; jCol[_count] = _tmp + k; _count += 1;
+                };
+                for(int k = 0; k < _tmp - 1; ++k) {
+                    iRow[_count] = _tmp + k; jCol[_count] = k + 1; _count += 1;
+                    iRow[_count] = _tmp + k; jCol[_count] = _tmp + k; _count += 1;
+                };
+                // Continuity rows -> dense in p_opt and s_i, -1 at s_{i+1}
+                for(int i = 0; i + 1 < n_segments(); ++i) {
+                    for(int a = 0; a < _n_x; ++a) {
+                        int _row = n_duration() + i * _n_x + a;
+                        for(int k = 0; k < _n_p; ++k) { iRow[_count] = _row; jCol[_count] = k; _count += 1; };
+                        if (i > 0) {
+                            for(int k = 0; k < _n_x; ++k) {
+                                iRow[_count] = _row; jCol[_count] = state_offset(i) + k; _count += 1;
+                            };
+                        };
+                        iRow[_count] = _row; jCol[_count] = state_offset(i + 1) + a; _count += 1;
+                    };
+                };
+            }
+            else
+            {
+                for(int k = 0; k < _tmp; ++k) { values[_count++] = -1.; values[_count++] = 1.; };
+                for(int k = 0; k < _tmp - 1; ++k) { values[_count++] = 1.; values[_count++] = -1.; };
+                differentiate(x);
+                for(int i = 0; i + 1 < n_segments(); ++i) {
+                    const vector<double> &_jac = _jacobians[i];
+                    for(int a = 0; a < _n_x; ++a) {
+                        for(int k = 0; k < _n_p; ++k) { values[_count++] = _jac(a * _cols + k); };
+                        if (i > 0) {
+                            for(int k = 0; k < _n_x; ++k) { values[_count++] = _jac(a * _cols + _n_p + k); };
+                        };
+                        values[_count++] = -1.;
+                    };
+                };
+            };
+            return true;
+        };
+        bool eval_h(
+                Index         n,
+                const Number* x,
+                bool          new_x,
+                Number        obj_factor,
+                Index         m,
+                const Number* lambda,
+                bool          new_lambda,
+                Index         nele_hess,
+                Index*        iRow,
+                Index*        jCol,
+                Number*       values
+        )
+        {
+            return true;
+        };
+        void finalize_solution(
+                SolverReturn               status,
+                Index                      n,
+                const Number*              x,
+                const Number*              z_L,
+                const Number*              z_U,
+                Index                      m,
+                const Number*              g,
+                const Number*              lambda,
+                Number                     obj_value,
+                const IpoptData*           ip_data,
+                IpoptCalculatedQuantities* ip_cq
+        )
+        {
+            _objective = obj_value;
+            _z_opt = Eigen::Map<const vector<double>>(x, n);
+            _states = matrix<double>::Zero(n_segments(), _n_x);
+            for(int i = 0; i < n_segments(); ++i) { _states.row(i) = segment_input(_z_opt, i).transpose(); };
+            // Hand the schedule back to the plant -> plant.get_p_optimize_ipopt() and get_objective() work
+            Plant &plant = *_plant;
+            plant._p_opt_ipopt = _z_opt.head(_n_p);
+            plant._objective = obj_value;
+        };
+
+    private:
+        int _n_p = 0;
+        int _n_x = 0;
+        std::vector<int> _first;      // First grid step of every segment (and the step count at the end)
+        vector<double> _dynamic;      // Dynamical parameters of the tapes
+        double _window = 0.;          // Price window sharpness of the tapes -> see Plant::sharpness_floor
+        vector<double> _start;
+        std::vector<ad_function> _tapes;
+        size_t _version = 0;
+        std::vector<std::vector<ad_function>> _copies; // Per-thread copies of the segment tapes
+        std::vector<std::vector<size_t>> _copy_version;
+        vector<double> _values_at, _jacobian_at;       // x of the cached segment values and Jacobians
+        std::vector<vector<double>> _values;           // (end state; cost) per segment
+        std::vector<vector<double>> _jacobians;        // Row-major (n_x + 1) x (n_p + n_x) per segment
+
+        int state_offset(const int i) const { return _n_p + (i - 1) * _n_x; };
+        // Initial state of segment i -> x0 or s_i
+        vector<double> segment_input(const vector<double> &z, const int i) const {
+            if (i == 0) { return (*_plant)._x0; };
+            return z.segment(state_offset(i), _n_x);
+        };
+        vector<double> input(const Number *x, const int i) const {
+            vector<double> _u(_n_p + _n_x);
+            for(int k = 0; k < _n_p; ++k) { _u(k) = x[k]; };
+            if (i == 0) { _u.tail(_n_x) = (*_plant)._x0; } else {
+                for(int k = 0; k < _n_x; ++k) { _u(_n_p + k) = x[state_offset(i) + k]; };
+            };
+            return _u;
+        };
+        // Integrate segment i from x -> (end state; cost of the end state)
+        template <typename scalar>
+        vector<scalar> segment(const int i, const vector<scalar> &dynamic, const vector<scalar> &p_opt,
+                               vector<scalar> x) {
+            Plant &plant = *_plant;
+            vector<scalar> p_const = dynamic.tail(plant._p_const.size());
+            PriceCurve<scalar> prices(dynamic, plant._price_index);
+            prices.window_sharpness = _window;
+            uint64_t _rhs = 0;
+            (*plant._model).integrate_steps(x, plant._t0 + _first[i] * plant._dt, plant._dt, _first[i + 1] - _first[i],
+                                            nullptr, prices, p_opt, p_const, _rhs);
+            vector<scalar> _out(_n_x + 1);
+            _out.head(_n_x) = x;
+            _out(_n_x) = plant.objective(x, dynamic, p_opt, p_const);
+            return _out;
+        };
+        bool cached(vector<double> &at, const Number *x) const {
+            Eigen::Map<const vector<double>> _x(x, n_z());
+            if (at.size() == _x.size() && at == _x) { return true; };
+            at = _x;
+            return false;
+        };
+        // Segment values at x -> parallel double integrations
+        void evaluate(const Number *x) {
+            if (cached(_values_at, x)) { return; };
+            _values.resize(n_segments());
+            parallel_for(n_segments(), _threads, [&] (size_t i, size_t thread) {
+                vector<double> _u = input(x, i);
+                _values[i] = segment<double>(i, _dynamic, _u.head(_n_p), _u.tail(_n_x));
+            });
+        };
+        // Segment Jacobians at x -> parallel sweeps on per-thread tape copies
+        void differentiate(const Number *x) {
+            if (cached(_jacobian_at, x)) { return; };
+            _jacobians.resize(n_segments());
+            parallel_for(n_segments(), _threads, [&] (size_t i, size_t thread) {
+                if (_copy_version[thread][i] != _version) {
+                    _copies[thread][i] = _tapes[i];
+                    _copy_version[thread][i] = _version;
+                };
+                _jacobians[i] = _copies[thread][i].Jacobian(input(x, i));
+            });
+        };
+    };
+    class Shooting {
+    public:
+        SmartPtr<ShootingPlant> shooting;
+        int _print_level = 0;
+        Shooting(const NLP &nlp) {
+            shooting = new ShootingPlant();
+            (*shooting)._plant = nlp.plant;
+        };
+        // Set functions
+        void set_segments(const int segments) { (*shooting)._segments = segments; };
+        void set_threads(const size_t threads) { (*shooting)._threads = threads; };
+        void set_print_level(const int print_level) { _print_level = print_level; };
+        // Get functions
+        const vector<double> &get_p_optimize_ipopt() const { return (*(*shooting)._plant)._p_opt_ipopt; };
+        const matrix<double> &get_states() const { return (*shooting)._states; };
+        const double &get_objective() const { return (*shooting)._objective; };
+        const int &get_init_status() const { return (*shooting)._status_init; };
+        const int &get_solve_status() const { return (*shooting)._status_solve; };
+        // Solver wrapper
+        void solve() {
+            TRACE_SCOPE("shooting_solve", "solve");
+            (*shooting).prepare();
+            SmartPtr<IpoptApplication> app = ipopt_application(_print_level);
+            (*shooting)._status_init = (int) app->Initialize();
+            (*shooting)._status_solve = (int) app->OptimizeTNLP(shooting);
+            (*(*shooting)._plant)._status_init = (*shooting)._status_init;
+            (*(*shooting)._plant)._status_solve = (*shooting)._status_solve;
+        };
+    };
+}
+
+#endif //SWITCHINGTIMES_SWITCHING_TIMES_SHOOTING_HPP
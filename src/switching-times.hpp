@@ -5,7 +5,6 @@
 #ifndef SWITCHINGTIMES_SWITCHING_TIMES_HPP
 #define SWITCHINGTIMES_SWITCHING_TIMES_HPP
 
-#include <pybind11/eigen.h>
 #include <Eigen/Dense>
 #include "cppad-eigen.hpp"
 #include <boost/numeric/odeint.hpp>
@@ -13,6 +12,27 @@
 #include <coin-or/IpIpoptApplication.hpp>
 #include <coin-or/IpTNLP.hpp>
 #include <coin-or/IpOptionsList.hpp>
+#include <coin-or/IpJournalist.hpp>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <cmath>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "lbfgsb.hpp"
+#include "parallel.hpp"
+#include "serialization.hpp"
+#include "telemetry.hpp"
+#include "trace.hpp"
 
 using namespace boost::numeric::odeint;
 using namespace Ipopt;
@@ -23,6 +43,13 @@ namespace SwitchingTimes {
      */
     template <typename scalar>
     using vector = Eigen::Matrix<scalar, Eigen::Dynamic, 1>;
+    template <typename scalar>
+    using matrix = Eigen::Matrix<scalar, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+    // Read-only views -> bound NumPy arrays are used in place (no conversion copy)
+    template <typename scalar>
+    using vector_ref = Eigen::Ref<const vector<scalar>>;
+    template <typename scalar>
+    using matrix_ref = Eigen::Ref<const matrix<scalar>>;
     typedef CppAD::ADFun<double> ad_function;
     typedef CppAD::AD<double> ad_double;
     /*
@@ -35,11 +62,470 @@ namespace SwitchingTimes {
      */
     double cexp(double x, double cap);
     CppAD::AD<double> cexp(CppAD::AD<double> x, double cap);
+    const double sigmoid_cap = 15.;
+    /*
+     * Interval index of a price curve with n intervals and n + 1 boundaries
+     *
+     * Uniformly spaced interior boundaries (the outer boundaries may be extended) are located in O(1), any other
+     * curve by binary search. The index only depends on the boundaries -> it is recorded on the tape, so a change
+     * of the boundaries (not of the prices) requires a new tape.
+     */
+    struct PriceIndex {
+        int n = 0;
+        bool uniform = false;
+        bool full = false;    // Always sum over all intervals (no windowing)
+        double t1 = 0.;       // First interior boundary
+        double h = 0.;        // Interior spacing
+        std::vector<double> times;
+
+        // Returns true if the index changed
+        bool update(const double *_times, const int _n, const bool _full) {
+            std::vector<double> _new(_times, _times + (_n + 1));
+            if (_n == n && _full == full && _new == times) { return false; };
+            n = _n;
+            full = _full;
+            times = _new;
+            uniform = false;
+            if (n >= 2) {
+                t1 = times[1];
+                h = (n > 2) ? (times[n - 1] - times[1]) / (n - 2) : times[1] - times[0];
+                uniform = h > 0.;
+                for(int k = 1; k < n - 1 && uniform; ++k) {
+                    uniform = std::abs(times[k + 1] - times[k] - h) <= 1e-9 * h;
+                };
+            };
+            return true;
+        };
+        // Interval k with times[k] <= t < times[k + 1], clamped to [0, n - 1]
+        int locate(const double t) const {
+            int _k;
+            if (uniform) {
+                _k = (t < t1) ? 0 : 1 + (int) std::min(std::floor((t - t1) / h), (double) n);
+            } else {
+                _k = (int) (std::upper_bound(times.begin(), times.end(), t) - times.begin()) - 1;
+            };
+            return std::max(0, std::min(_k, n - 1));
+        };
+    };
+    /*
+     * Shared cache of price activations on the fixed-step integration grid t0 + n * dt (+ dopri5 stage offsets)
+     *
+     * The activation only depends on t, the sharpness and the prices, so plants integrating the same price curve
+     * share it. Values are stored per sharpness while filling (sequential) and only read afterwards -> concurrent
+     * readers need no locking. Times off the grid are evaluated directly.
+     */
+    class PriceTable {
+    public:
+        static constexpr int n_nodes = 5;
+        static constexpr double nodes[n_nodes] = {0., 1. / 5., 3. / 10., 4. / 5., 8. / 9.};
+        double t0;
+        double dt;
+        int n_steps;
+        bool filling = false;
+        std::map<double, std::vector<double>> values; // Sharpness -> (n_steps + 1) x n_nodes activations
+
+        PriceTable(const double _t0, const double _dt, const int _n_steps) : t0(_t0), dt(_dt), n_steps(_n_steps) {};
+        // Grid slot of t -> -1 if t is not on the grid
+        int slot(const double t) const {
+            if (dt <= 0.) { return -1; };
+            double _s = (t - t0) / dt;
+            double _n = std::floor(_s + 1e-9);
+            if (_n < 0. || _n > n_steps) { return -1; };
+            for(int k = 0; k < n_nodes; ++k) {
+                if (std::abs(_s - _n - nodes[k]) <= 1e-9) { return (int) _n * n_nodes + k; };
+            };
+            return -1;
+        };
+        template <typename Curve>
+        double activation(const Curve &curve, const double t, const double sharpness) {
+            int _slot = slot(t);
+            if (_slot < 0) { return curve.evaluate(t, sharpness, sharpness); };
+            auto _it = values.find(sharpness);
+            if (_it == values.end()) {
+                if (!filling) { return curve.evaluate(t, sharpness, sharpness); };
+                _it = values.emplace(sharpness, std::vector<double>((n_steps + 1) * n_nodes, NAN)).first;
+            };
+            double _value = _it->second[_slot];
+            if (std::isnan(_value)) {
+                _value = curve.evaluate(t, sharpness, sharpness);
+                if (filling) { _it->second[_slot] = _value; };
+            };
+            return _value;
+        };
+    };
+    /*
+     * Price curve view of p_dynamic = (prices (n); boundaries (n + 1); ...) with sigmoid price activation
+     *
+     * Intervals further than window_exponent / sharpness from t have both sigmoid factors saturated: one at the
+     * cap and one at 1 (up to exp(-window_exponent)). Their contribution is the capped constant times their
+     * price, taken from prefix sums -> the activation costs O(1) per evaluation regardless of the curve length.
+     * The double version can read from a shared PriceTable.
+     */
+    template <typename scalar>
+    class PriceCurve {
+    public:
+        const PriceIndex &index;
+        Eigen::Map<const vector<scalar>> prices;
+        Eigen::Map<const vector<scalar>> times;
+        vector<scalar> _prefix;             // Own storage of prefix -> empty if a buffer was given
+        Eigen::Map<vector<scalar>> prefix;  // prefix(k) = sum of the first k prices
+        PriceTable *table;
+        scalar saturated = 0.;        // Capped contribution of prices left out of the curve (see Plant::integrate_events)
+        double window_sharpness = 0.; // Lower bound of a taped (dynamic) sharpness -> sizes the window, 0 sums all
+        static constexpr double window_exponent = 40.;
+
+        // buffer -> caller-owned storage of the prefix sums (e.g. a Plant::Workspace), so no allocation per curve
+        PriceCurve(const vector<scalar> &p_dynamic, const PriceIndex &_index, PriceTable *_table = nullptr,
+                   vector<scalar> *buffer = nullptr) :
+                index(_index), prices(p_dynamic.data(), _index.n), times(p_dynamic.data() + _index.n, _index.n + 1),
+                _prefix(buffer == nullptr ? _index.n + 1 : 0),
+                prefix(storage(buffer, _prefix, _index.n + 1), _index.n + 1), table(_table) {
+            prefix(0) = 0.;
+            for(int k = 0; k < index.n; ++k) { prefix(k + 1) = prefix(k) + prices(k); };
+        };
+        // prefix maps _prefix or the buffer -> a copy would map the storage of the original
+        PriceCurve(const PriceCurve &) = delete;
+        PriceCurve &operator=(const PriceCurve &) = delete;
+        scalar activation(const double t, const scalar &sharpness) const {
+            if constexpr (std::is_same<scalar, double>::value) {
+                if (table != nullptr) { return table->activation(*this, t, sharpness); };
+                return evaluate(t, sharpness, sharpness);
+            } else {
+                return evaluate(t, sharpness, window_sharpness);
+            };
+        };
+        // Terms beyond window_exponent / window sharpness of t are saturated -> taken from the prefix sums
+        scalar evaluate(const double t, const scalar &sharpness, const double window) const {
+            int lo = 0, hi = index.n - 1;
+            scalar _out = saturated;
+            if (!index.full && window > 0.) {
+                double _delta = window_exponent / window;
+                lo = index.locate(t - _delta);
+                hi = index.locate(t + _delta);
+                _out += (prefix(lo) + prefix(index.n) - prefix(hi + 1)) / (1. + std::exp(sigmoid_cap));
+            };
+            for(int k = lo; k <= hi; ++k) {
+                _out += prices(k) / ((1. + cexp(-sharpness * (t - times(k)), sigmoid_cap)) *
+                                     (1. + cexp( sharpness * (t - times(k + 1)), sigmoid_cap)));
+            };
+            return _out;
+        };
+
+    private:
+        static scalar *storage(vector<scalar> *buffer, vector<scalar> &own, const int n) {
+            if (buffer == nullptr) { return own.data(); };
+            if ((*buffer).size() != n) { (*buffer).resize(n); };
+            return (*buffer).data();
+        };
+    };
+    /*
+     * Model interface -> ODE right-hand side, Mayer cost and integration kernels of a plant type
+     *
+     * The plant integrates through the kernels, one (type-erased) call per integration -> the ODE solver runs inside
+     * the model, specialized on its state size. The single right-hand-side calls are left for pointwise users
+     * (collocation defects, the DP rollouts). New plant types derive from ModelBase (below) instead of
+     * implementing this interface directly.
+     */
+    class Model {
+    public:
+        virtual ~Model() = default;
+        virtual std::string name() const = 0;
+        virtual int n_state() const = 0;
+        virtual int n_const() const = 0;
+        /*
+         * Indices of the sigmoid sharpness constants in p_const -> scaled by the continuation of NLP::solve.
+         * Event-located steps (Plant::set_events) rely on the model seeing time only as sharpness * (t - time), with
+         * every such sharpness listed here; models without sharpness constants cannot use them.
+         */
+        virtual std::vector<int> sharpness() const { return {}; };
+        virtual void rhs(const vector<double> &x, vector<double> &dxdt, const double t, const PriceCurve<double> &prices,
+                         const vector<double> &p_opt, const vector<double> &p_const) const = 0;
+        virtual void rhs(const vector<ad_double> &x, vector<ad_double> &dxdt, const double t,
+                         const PriceCurve<ad_double> &prices, const vector<ad_double> &p_opt,
+                         const vector<ad_double> &p_const) const = 0;
+        virtual double cost(const vector<double> &x, const vector<double> &p_dynamic, const vector<double> &p_opt,
+                            const vector<double> &p_const) const = 0;
+        virtual ad_double cost(const vector<ad_double> &x, const vector<ad_double> &p_dynamic,
+                               const vector<ad_double> &p_opt, const vector<ad_double> &p_const) const = 0;
+        /*
+         * Integration kernels -> x is integrated in place, rhs counts the right-hand-side evaluations and the
+         * number of steps is returned
+         */
+        // Fixed dopri5 steps of size dt from t1 to t2
+        virtual size_t integrate(vector<double> &x, const double t1, const double t2, const double dt,
+                                 const PriceCurve<double> &prices, const vector<double> &p_opt,
+                                 const vector<double> &p_const, uint64_t &rhs) const = 0;
+        virtual size_t integrate(vector<ad_double> &x, const double t1, const double t2, const double dt,
+                                 const PriceCurve<ad_double> &prices, const vector<ad_double> &p_opt,
+                                 const vector<ad_double> &p_const, uint64_t &rhs) const = 0;
+        // n fixed dopri5 steps of size dt from t, the right-hand side multiplied by *scale (unless nullptr)
+        virtual size_t integrate_steps(vector<double> &x, const double t, const double dt, const size_t n,
+                                       const double *scale, const PriceCurve<double> &prices,
+                                       const vector<double> &p_opt, const vector<double> &p_const,
+                                       uint64_t &rhs) const = 0;
+        virtual size_t integrate_steps(vector<ad_double> &x, const double t, const double dt, const size_t n,
+                                       const ad_double *scale, const PriceCurve<ad_double> &prices,
+                                       const vector<ad_double> &p_opt, const vector<ad_double> &p_const,
+                                       uint64_t &rhs) const = 0;
+        // Adaptive dopri5 with dense output from times.front() -> observer(x, t) at every time
+        typedef std::function<void(const vector_ref<double> &, const double)> observer;
+        virtual size_t integrate_dense(vector<double> &x, const std::vector<double> &times, const double dt,
+                                       const double abs_tol, const double rel_tol, const PriceCurve<double> &prices,
+                                       const vector<double> &p_opt, const vector<double> &p_const,
+                                       const observer &observe, uint64_t &rhs) const = 0;
+    };
+    /*
+     * Compile-time model definition (CRTP)
+     *
+     * Derived provides
+     *   static constexpr const char *model_name;
+     *   template <typename scalar> static void rhs(const state<scalar> &x, derivative<scalar> &dxdt, const double t,
+     *       const PriceCurve<scalar> &prices, const vector<scalar> &p_opt, const constants<scalar> &p_const);
+     *   template <typename scalar> static scalar cost(const state<scalar> &x, const vector<scalar> &p_dynamic,
+     *       const vector<scalar> &p_opt, const constants<scalar> &p_const);
+     * ... the state and constants are fixed-size views, so the model code is compiled with the dimensions known.
+     * The integration kernels run odeint on fixed-size states (state_vector) with Derived::rhs inlined into the
+     * stepper. p_opt keeps the switching layout (ON-vec; OFF-vec) of all plants. p_const is a dynamic parameter
+     * of the tape (new values do not retape), hence also of the AD scalar type.
+     */
+    template <typename Derived, int N_STATE, int N_CONST>
+    class ModelBase: public Model {
+    public:
+        static constexpr int state_size = N_STATE;
+        static constexpr int const_size = N_CONST;
+        template <typename scalar>
+        using state = Eigen::Map<const Eigen::Matrix<scalar, N_STATE, 1>>;
+        template <typename scalar>
+        using derivative = Eigen::Map<Eigen::Matrix<scalar, N_STATE, 1>>;
+        template <typename scalar>
+        using constants = Eigen::Map<const Eigen::Matrix<scalar, N_CONST, 1>>;
+        template <typename scalar>
+        using state_vector = Eigen::Matrix<scalar, N_STATE, 1>;
+
+        std::string name() const { return Derived::model_name; };
+        int n_state() const { return N_STATE; };
+        int n_const() const { return N_CONST; };
+        void rhs(const vector<double> &x, vector<double> &dxdt, const double t, const PriceCurve<double> &prices,
+                 const vector<double> &p_opt, const vector<double> &p_const) const {
+            dispatch_rhs<double>(x, dxdt, t, prices, p_opt, p_const);
+        };
+        void rhs(const vector<ad_double> &x, vector<ad_double> &dxdt, const double t,
+                 const PriceCurve<ad_double> &prices, const vector<ad_double> &p_opt,
+                 const vector<ad_double> &p_const) const {
+            dispatch_rhs<ad_double>(x, dxdt, t, prices, p_opt, p_const);
+        };
+        double cost(const vector<double> &x, const vector<double> &p_dynamic, const vector<double> &p_opt,
+                    const vector<double> &p_const) const {
+            return Derived::template cost<double>(state<double>(x.data()), p_dynamic, p_opt,
+                                                  constants<double>(p_const.data()));
+        };
+        ad_double cost(const vector<ad_double> &x, const vector<ad_double> &p_dynamic, const vector<ad_double> &p_opt,
+                       const vector<ad_double> &p_const) const {
+            return Derived::template cost<ad_double>(state<ad_double>(x.data()), p_dynamic, p_opt,
+                                                     constants<ad_double>(p_const.data()));
+        };
+        size_t integrate(vector<double> &x, const double t1, const double t2, const double dt,
+                         const PriceCurve<double> &prices, const vector<double> &p_opt, const vector<double> &p_const,
+                         uint64_t &rhs) const {
+            return integrate_kernel<double>(x, t1, t2, dt, prices, p_opt, p_const, rhs);
+        };
+        size_t integrate(vector<ad_double> &x, const double t1, const double t2, const double dt,
+                         const PriceCurve<ad_double> &prices, const vector<ad_double> &p_opt,
+                         const vector<ad_double> &p_const, uint64_t &rhs) const {
+            return integrate_kernel<ad_double>(x, t1, t2, dt, prices, p_opt, p_const, rhs);
+        };
+        size_t integrate_steps(vector<double> &x, const double t, const double dt, const size_t n,
+                               const double *scale, const PriceCurve<double> &prices, const vector<double> &p_opt,
+                               const vector<double> &p_const, uint64_t &rhs) const {
+            return steps_kernel<double>(x, t, dt, n, scale, prices, p_opt, p_const, rhs);
+        };
+        size_t integrate_steps(vector<ad_double> &x, const double t, const double dt, const size_t n,
+                               const ad_double *scale, const PriceCurve<ad_double> &prices,
+                               const vector<ad_double> &p_opt, const vector<ad_double> &p_const,
+                               uint64_t &rhs) const {
+            return steps_kernel<ad_double>(x, t, dt, n, scale, prices, p_opt, p_const, rhs);
+        };
+        size_t integrate_dense(vector<double> &x, const std::vector<double> &times, const double dt,
+                               const double abs_tol, const double rel_tol, const PriceCurve<double> &prices,
+                               const vector<double> &p_opt, const vector<double> &p_const,
+                               const observer &observe, uint64_t &rhs) const {
+            state_vector<double> _x = x;
+            constants<double> _p_const(p_const.data());
+            size_t _steps = integrate_times(make_dense_output(abs_tol, rel_tol,
+                                                              runge_kutta_dopri5<state_vector<double>>()),
+                                            [&] (const state_vector<double> &x, state_vector<double> &dxdt,
+                                                 const double t) {
+                                                ++rhs;
+                                                call_rhs<double>(x, dxdt, t, prices, p_opt, _p_const);
+                                            }, _x, times.begin(), times.end(), dt,
+                                            [&] (const state_vector<double> &x, const double t) { observe(x, t); });
+            x = _x;
+            return _steps;
+        };
+
+    private:
+        template <typename scalar>
+        static void call_rhs(const state_vector<scalar> &x, state_vector<scalar> &dxdt, const double t,
+                             const PriceCurve<scalar> &prices, const vector<scalar> &p_opt,
+                             const constants<scalar> &p_const) {
+            derivative<scalar> _dxdt(dxdt.data());
+            Derived::template rhs<scalar>(state<scalar>(x.data()), _dxdt, t, prices, p_opt, p_const);
+        };
+        template <typename scalar>
+        static size_t integrate_kernel(vector<scalar> &x, const double t1, const double t2, const double dt,
+                                       const PriceCurve<scalar> &prices, const vector<scalar> &p_opt,
+                                       const vector<scalar> &p_const, uint64_t &rhs) {
+            state_vector<scalar> _x = x;
+            constants<scalar> _p_const(p_const.data());
+            runge_kutta_dopri5<state_vector<scalar>> _stepper;
+            size_t _steps = integrate_const(_stepper,
+                                            [&] (const state_vector<scalar> &x, state_vector<scalar> &dxdt,
+                                                 const double t) {
+                                                ++rhs;
+                                                call_rhs<scalar>(x, dxdt, t, prices, p_opt, _p_const);
+                                            }, _x, t1, t2, dt);
+            x = _x;
+            return _steps;
+        };
+        template <typename scalar>
+        static size_t steps_kernel(vector<scalar> &x, const double t, const double dt, const size_t n,
+                                   const scalar *scale, const PriceCurve<scalar> &prices,
+                                   const vector<scalar> &p_opt, const vector<scalar> &p_const, uint64_t &rhs) {
+            state_vector<scalar> _x = x;
+            constants<scalar> _p_const(p_const.data());
+            runge_kutta_dopri5<state_vector<scalar>> _stepper;
+            integrate_n_steps(_stepper, [&] (const state_vector<scalar> &x, state_vector<scalar> &dxdt,
+                                             const double t) {
+                                  ++rhs;
+                                  call_rhs<scalar>(x, dxdt, t, prices, p_opt, _p_const);
+                                  if (scale != nullptr) { dxdt *= *scale; };
+                              }, _x, t, dt, n);
+            x = _x;
+            return n;
+        };
+        template <typename scalar>
+        static void dispatch_rhs(const vector<scalar> &x, vector<scalar> &dxdt, const double t,
+                                 const PriceCurve<scalar> &prices, const vector<scalar> &p_opt,
+                                 const vector<scalar> &p_const) {
+            derivative<scalar> _dxdt(dxdt.data());
+            Derived::template rhs<scalar>(state<scalar>(x.data()), _dxdt, t, prices, p_opt,
+                                          constants<scalar>(p_const.data()));
+        };
+    };
+    /*
+     * Model registry -> name to factory
+     *
+     * Starts with the built-in models (builtin_models, defined next to the models so that linking the core library
+     * always links them), further models are added with register_model<Derived>().
+     */
+    typedef std::function<std::shared_ptr<const Model>()> model_factory;
+    template <typename Derived>
+    std::pair<std::string, model_factory> model_entry() {
+        return {Derived::model_name, [] { return std::make_shared<const Derived>(); }};
+    };
+    std::map<std::string, model_factory> builtin_models();
+    inline std::map<std::string, model_factory> &model_registry() {
+        static std::map<std::string, model_factory> _registry = builtin_models();
+        return _registry;
+    };
+    template <typename Derived>
+    bool register_model() {
+        model_registry().insert_or_assign(Derived::model_name, model_entry<Derived>().second);
+        return true;
+    };
+    inline std::shared_ptr<const Model> make_model(const std::string &name) {
+        auto _it = model_registry().find(name);
+        if (_it == model_registry().end()) {
+            std::string _known;
+            for(const auto &_item : model_registry()) { _known += (_known.empty() ? "" : ", ") + _item.first; };
+            throw std::invalid_argument("Unknown model '" + name + "' -> registered models: " + _known);
+        };
+        return _it->second();
+    };
+    inline std::vector<std::string> model_names() {
+        std::vector<std::string> _out;
+        for(const auto &_item : model_registry()) { _out.push_back(_item.first); };
+        return _out;
+    };
+    // Model of a default constructed plant
+    const std::string default_model = "wastewater";
+    /*
+     * Progress of a solve as reported to the iteration callback
+     */
+    struct Progress {
+        int iteration;
+        double objective;
+        double inf_pr;  // Primal infeasibility
+        double inf_du;  // Dual infeasibility (projected gradient norm for the L-BFGS-B backend)
+        double elapsed; // Seconds since the start of the solve
+    };
+    /*
+     * Stage of a sharpness continuation (see NLP::solve)
+     */
+    struct ContinuationStage {
+        double factor;  // Scale of the model's sharpness constants
+        int iterations;
+        double objective;
+        int status;
+    };
+    /*
+     * IPOPT journal that keeps the solver output in memory
+     */
+    class MemoryJournal: public Journal {
+    public:
+        std::string buffer;
+        MemoryJournal(const std::string &name, EJournalLevel level) : Journal(name, level) {};
+    protected:
+        void PrintImpl(EJournalCategory category, EJournalLevel level, const char *str) { buffer += str; };
+        void PrintfImpl(EJournalCategory category, EJournalLevel level, const char *pformat, va_list ap) {
+            char _line[512];
+            va_list _ap;
+            va_copy(_ap, ap);
+            int _n = std::vsnprintf(_line, sizeof(_line), pformat, ap);
+            if (_n >= (int) sizeof(_line)) {
+                std::string _long(_n + 1, '\0');
+                std::vsnprintf(&_long[0], _long.size(), pformat, _ap);
+                buffer.append(_long.data(), _n);
+            } else if (_n > 0) {
+                buffer.append(_line, _n);
+            };
+            va_end(_ap);
+        };
+        void FlushBufferImpl() {};
+    };
+    // max(x, floor) for both scalar types -> a conditional expression on the tape
+    template <typename scalar>
+    scalar at_least(const scalar &x, const double floor) {
+        if constexpr (std::is_same<scalar, double>::value) {
+            return std::max(x, floor);
+        } else {
+            return CppAD::CondExpGt(x, scalar(floor), x, scalar(floor));
+        };
+    };
+    /*
+     * Problem specification -> unset fields are left unchanged by Plant::configure
+     */
+    struct Spec {
+        std::optional<vector<double>> p_const;
+        std::optional<vector<double>> p_dynamic;
+        std::optional<vector<double>> p_optimize;
+        std::optional<vector<double>> x0;
+        std::optional<double> t0;
+        std::optional<double> tf;
+        std::optional<double> dt;
+        std::optional<vector<double>> lower_bound;
+        std::optional<vector<double>> upper_bound;
+        std::optional<vector<double>> on_bound;
+        std::optional<vector<double>> off_bound;
+        std::optional<std::string> model;
+    };
     /*
      * Class that defines a PLANT w. switched dynamics
      */
     class Plant: public TNLP {
     public:
+        // Plant type -> ODE right-hand side and cost (see Model)
+        std::shared_ptr<const Model> _model = make_model(default_model);
         // Plant variables
         vector<double> _p_const;     // Constant parameters
         vector<double> _p_dynamic;   // Dynamical parameters
@@ -52,9 +538,9 @@ namespace SwitchingTimes {
         vector<double> _on_bound;
         vector<double> _off_bound;
         // Optimization horizon and discretization used in objective function (+ tape)
-        double _t0; // Optimization starting time
-        double _tf; // Optimization end time
-        double _dt; // ODE-solver discretization
+        double _t0 = 0.; // Optimization starting time
+        double _tf = 0.; // Optimization end time
+        double _dt = 0.; // ODE-solver discretization
         // ODE initial values
         vector<double> _x0; // Initial state values
         // Tape of objective
@@ -62,36 +548,211 @@ namespace SwitchingTimes {
         // Bool variables for tape logic
         bool new_tape = true;
         bool new_dynamic = false;
+        size_t tape_version = 0; // Incremented on every recording
+        double _tape_sharpness = 0.; // Sharpness floor at the recording -> see sharpness_floor
+        // Interval index of the price curve in p_dynamic -> its length is (p_dynamic.size() - 1) / 2
+        PriceIndex _price_index;
+        // Price activations shared with other plants on the same price curve (see Fleet) -> reset with p_dynamic
+        std::shared_ptr<PriceTable> _price_table;
+        // Scenario mode -> objective is the weighted sum over p_dynamic scenarios (one per row)
+        matrix<double> _p_scenarios;
+        vector<double> _w_scenarios;
+        size_t _scenario_threads = max_threads();
+        std::vector<ad_function> thread_tapes;  // Per-thread copies of objective_tape
+        std::vector<size_t> thread_tape_version;
+        size_t dynamic_version = 0;             // Incremented when objective_tape gets new dynamical parameters
+        std::vector<size_t> thread_dynamic_version;
+        /*
+         * Scratch space of the double evaluation path (eval_f, eval_grad_f, objective_wrapper) -> one per thread, so
+         * steady-state iterations reuse the buffers instead of allocating (the stepper of Model::integrate works on
+         * fixed-size states and needs none). The tape sweeps take CppAD vectors, which draw from the thread_alloc
+         * pools (see hold_memory). Event-located steps (_events) are excluded: the double path builds the segment
+         * curves of integrate_events on every call.
+         */
+        struct Workspace {
+            vector<double> p_opt;
+            vector<double> x;
+            vector<double> prefix;                      // Price prefix sums (see PriceCurve)
+            CppAD::vector<double> u;                    // Independent variables of the tape
+            CppAD::vector<double> w;                    // Range weights of the reverse sweep
+        };
+        std::vector<Workspace> _workspaces = std::vector<Workspace>(max_threads());
+        /*
+         * Event-located integration grid (see integrate_events) -> segment boundaries at every switch time s, at
+         * s -/+ width and at every price boundary inside (t0, tf), sorted by time. The plan belongs to a tape: a new
+         * order of the events needs a new recording, while the order is unchanged the double path uses the plan
+         * (and step counts) of the tape, so objective values and gradients stay consistent as switch times move.
+         */
+        struct EventPlan {
+            std::vector<int> order;  // Event ids -> 3 k + 0/1/2 for s_k - width/s_k/s_k + width, 3 n_p + j for time j
+            std::vector<int> steps;  // Steps per segment (order.size() + 1 segments)
+            std::vector<int> lo, hi; // Price intervals within reach of each segment
+            double t0 = 0., tf = 0., dt = 0., width = 0.;
+            int window_steps = 0;
+        };
+        bool _events = false;       // Event-located integration steps in the objective (and its tape)
+        double _event_width = 0.;   // Half width of the refined window around a switch -> 0 means 4 / sharpness floor
+        int _event_steps = 4;       // Steps per half window
+        EventPlan _event_plan;      // Plan of objective_tape
         // IPOPT application status
-        int _status_init;
-        int _status_solve;
+        int _status_init = 0;
+        int _status_solve = 0;
+        double _objective = 0.; // Objective value at the returned solution
+        // Iteration callback -> returning false stops the solve
+        std::function<bool(const Progress &)> _callback;
+        // Stop when the objective improved less than _stall_tol (relative) over the last _stall_iter iterations
+        double _stall_tol = 0.;  // Disabled when 0
+        int _stall_iter = 5;
+        double _stall_inf_pr = 1e-4; // ... and the iterate is feasible up to this tolerance
+        std::deque<double> _progress_history;
+        std::chrono::steady_clock::time_point _solve_start;
+        bool _stopped_early = false;
+        std::string _journal; // Solver output of the last solve
+        // Telemetry of the last solve (see telemetry.hpp) -> reset by start_progress
+        Telemetry _telemetry;
+        int _iterations = 0;
+        int64_t _trace_mark = 0; // End of the last traced callback (see TraceScope)
+        // IPOPT multipliers at the returned solution (bounds and constraints) -> empty after an L-BFGS-B solve
+        vector<double> _z_L;
+        vector<double> _z_U;
+        vector<double> _lambda;
+        static const uint32_t serialization_magic = 0x4c505453; // "STPL"
+        static const uint32_t serialization_version = 6;
         // Set functions
-        void set_p_const(const vector<double> &p_const) {
+        void set_p_const(const vector_ref<double> &p_const) {
             if (p_const.size() != _p_const.size() ) { new_tape = true; };
+            new_dynamic = true; // p_const is a dynamical parameter of the tape
             _p_const = p_const;
         };
-        void set_p_dynamic(const vector<double> &p_dynamic) {
+        void set_p_dynamic(const vector_ref<double> &p_dynamic) {
             if (p_dynamic.size() != _p_dynamic.size()) { new_tape = true; };
             new_dynamic = true;
             _p_dynamic = p_dynamic;
+            _price_table = nullptr;
+            if (update_price_index()) { new_tape = true; };
+        };
+        // Rebuild the price interval index -> returns true if it changed (the tape depends on it)
+        bool update_price_index() {
+            if (_p_dynamic.size() == 0) { return false; };
+            int n = (_p_dynamic.size() - 1) / 2;
+            // Scenarios with other price times than p_dynamic cannot share the index -> sum over all intervals
+            bool _full = false;
+            for(int k = 0; k < _p_scenarios.rows() && _p_scenarios.cols() == _p_dynamic.size(); ++k) {
+                _full = _full || _p_scenarios.row(k).segment(n, n + 1) != _p_dynamic.segment(n, n + 1).transpose();
+            };
+            return _price_index.update(_p_dynamic.data() + n, n, _full);
         };
-        void set_p_optimize(const vector<double> &p_opt) {
+        void set_p_optimize(const vector_ref<double> &p_opt) {
             if (p_opt.size() != _p_opt.size() ) { new_tape = true; };
             _p_opt = p_opt;
             _p_opt_ipopt = vector<double>::Zero(p_opt.size());
         };
-        void set_t0(const double t0) { _t0 = t0; };
-        void set_tf(const double tf) { _tf = tf; };
-        void set_dt(const double dt) { _dt = dt; };
-        void set_lower_bound(const vector<double> &lower_bound) { _lower_bound = lower_bound; };
-        void set_upper_bound(const vector<double> &upper_bound) { _upper_bound = upper_bound; };
-        void set_on_bound(const vector<double> &on_bound) { _on_bound = on_bound; };
-        void set_off_bound(const vector<double> &off_bound) { _off_bound = off_bound; };
-        void set_x0(const vector<double> x0) {
+        // The integration grid is recorded on the tape -> a changed horizon or discretization needs a new tape
+        void set_t0(const double t0) {
+            if (t0 != _t0) { new_tape = true; };
+            _t0 = t0;
+        };
+        void set_tf(const double tf) {
+            if (tf != _tf) { new_tape = true; };
+            _tf = tf;
+        };
+        void set_dt(const double dt) {
+            if (dt != _dt) { new_tape = true; };
+            _dt = dt;
+        };
+        void set_events(const bool events) {
+            if (events != _events) { new_tape = true; };
+            _events = events;
+        };
+        void set_event_width(const double width) {
+            if (width != _event_width) { new_tape = true; };
+            _event_width = width;
+        };
+        void set_event_steps(const int steps) {
+            if (steps < 1) { throw std::invalid_argument("Expected at least one step per event window"); };
+            if (steps != _event_steps) { new_tape = true; };
+            _event_steps = steps;
+        };
+        void set_lower_bound(const vector_ref<double> &lower_bound) { _lower_bound = lower_bound; };
+        void set_upper_bound(const vector_ref<double> &upper_bound) { _upper_bound = upper_bound; };
+        void set_on_bound(const vector_ref<double> &on_bound) { _on_bound = on_bound; };
+        void set_off_bound(const vector_ref<double> &off_bound) { _off_bound = off_bound; };
+        void set_x0(const vector_ref<double> &x0) {
             if (x0.size() != _x0.size()) { new_tape = true; };
+            new_dynamic = true; // x0 is a dynamical parameter of the tape
             _x0 = x0;
         };
+        void set_model(const std::string &name) {
+            if (name != _model->name()) {
+                _model = make_model(name);
+                new_tape = true;
+            };
+        };
+        // Set all given fields at once -> the tape decision is taken once for the whole specification
+        void configure(const Spec &spec) {
+            bool _retape = false;
+            bool _dynamic = false;
+            if (spec.model && *spec.model != _model->name()) { _retape = true; _model = make_model(*spec.model); };
+            if (spec.p_const) {
+                _retape |= spec.p_const->size() != _p_const.size();
+                _dynamic = true;
+                _p_const = *spec.p_const;
+            };
+            if (spec.p_dynamic) {
+                _retape |= spec.p_dynamic->size() != _p_dynamic.size();
+                _dynamic = true;
+                _p_dynamic = *spec.p_dynamic;
+                _price_table = nullptr;
+                _retape |= update_price_index();
+            };
+            if (spec.p_optimize) {
+                _retape |= spec.p_optimize->size() != _p_opt.size();
+                _p_opt = *spec.p_optimize;
+                _p_opt_ipopt = vector<double>::Zero(_p_opt.size());
+            };
+            if (spec.x0) { _retape |= spec.x0->size() != _x0.size(); _dynamic = true; _x0 = *spec.x0; };
+            if (spec.t0) { _retape |= *spec.t0 != _t0; _t0 = *spec.t0; };
+            if (spec.tf) { _retape |= *spec.tf != _tf; _tf = *spec.tf; };
+            if (spec.dt) { _retape |= *spec.dt != _dt; _dt = *spec.dt; };
+            if (spec.lower_bound) { _lower_bound = *spec.lower_bound; };
+            if (spec.upper_bound) { _upper_bound = *spec.upper_bound; };
+            if (spec.on_bound) { _on_bound = *spec.on_bound; };
+            if (spec.off_bound) { _off_bound = *spec.off_bound; };
+            new_tape = new_tape || _retape;
+            new_dynamic = new_dynamic || _dynamic;
+        };
+        void set_scenarios(const matrix_ref<double> &p_scenarios, const vector_ref<double> &w_scenarios) {
+            if (p_scenarios.rows() != w_scenarios.size() || p_scenarios.rows() == 0) {
+                throw std::invalid_argument("Expected one weight per scenario (row of p_scenarios)");
+            };
+            // The tape is recorded at the first scenario -> only the size of p_dynamic matters
+            if (p_scenarios.cols() != _p_dynamic.size()) { set_p_dynamic(p_scenarios.row(0).transpose()); };
+            _p_scenarios = p_scenarios;
+            _w_scenarios = w_scenarios;
+            if (update_price_index()) { new_tape = true; };
+        };
+        void clear_scenarios() {
+            _p_scenarios.resize(0, 0);
+            _w_scenarios.resize(0);
+            if (update_price_index()) { new_tape = true; };
+        };
+        // Copy everything but the independent variables and their bounds (tape logic is handled by the setters)
+        void copy_configuration(const Plant &other) {
+            if (other._model != _model) { _model = other._model; new_tape = true; };
+            set_p_const(other._p_const);
+            set_p_dynamic(other._p_dynamic);
+            set_t0(other._t0);
+            set_tf(other._tf);
+            set_dt(other._dt);
+            set_events(other._events);
+            set_event_width(other._event_width);
+            set_event_steps(other._event_steps);
+            set_x0(other._x0);
+            set_on_bound(other._on_bound);
+            set_off_bound(other._off_bound);
+        };
         // Get functions
+        std::string get_model() const { return _model->name(); };
         const vector<double> &get_p_const() const { return _p_const; };
         const vector<double> &get_p_dynamic() const { return _p_dynamic; };
         const vector<double> &get_p_optimize() const { return _p_opt; };
@@ -99,64 +760,323 @@ namespace SwitchingTimes {
         const double &get_t0() const { return _t0; };
         const double &get_tf() const { return _tf; };
         const double &get_dt() const { return _dt; };
+        const bool &get_events() const { return _events; };
+        const double &get_event_width() const { return _event_width; };
+        const int &get_event_steps() const { return _event_steps; };
         const vector<double> &get_x0() const { return _x0; };
         const vector<double> &get_lower_bound() const { return _lower_bound; };
-        const vector<double> &get_upper_bound() const { return _lower_bound; };
+        const vector<double> &get_upper_bound() const { return _upper_bound; };
         const vector<double> &get_on_bound() const { return _on_bound; };
         const vector<double> &get_off_bound() const { return _off_bound; };
         const int &get_init_status() const { return _status_init; };
         const int &get_solve_status() const { return _status_solve; };
-        // ODE right-hand-side function template
+        const double &get_objective() const { return _objective; };
+        const vector<double> &get_z_L() const { return _z_L; };
+        const vector<double> &get_z_U() const { return _z_U; };
+        const std::string &get_journal() const { return _journal; };
+        const bool &get_stopped_early() const { return _stopped_early; };
+        SolveStats get_stats() const {
+            SolveStats _out = _telemetry.snapshot();
+            _out.tape_size_var = new_tape ? 0 : objective_tape.size_var();
+            _out.tape_size_op = new_tape ? 0 : objective_tape.size_op();
+            _out.iterations = _iterations;
+            _out.objective = _objective;
+            return _out;
+        };
+        const vector<double> &get_lambda() const { return _lambda; };
+        const matrix<double> &get_scenarios() const { return _p_scenarios; };
+        const vector<double> &get_scenario_weights() const { return _w_scenarios; };
+        // ODE right-hand-side function template -> delegates to the model
         template <typename scalar>
         void model(const vector<scalar> &x, vector<scalar> &dxdt,
                    const double t,
-                   const vector<scalar> &p_dynamic, const vector<scalar> &p_opt, const vector<double> &p_const);
+                   const PriceCurve<scalar> &prices, const vector<scalar> &p_opt, const vector<scalar> &p_const) {
+            _model->rhs(x, dxdt, t, prices, p_opt, p_const);
+        };
         // Objective function template (Mayer form -> end-point condition only)
         template <typename scalar>
         scalar objective(const vector<scalar> &x,
-                         const vector<scalar> &p_dynamic, const vector<scalar> &p_opt, const vector<double> &p_const);
+                         const vector<scalar> &p_dynamic, const vector<scalar> &p_opt, const vector<scalar> &p_const) {
+            return _model->cost(x, p_dynamic, p_opt, p_const);
+        };
+        // Dimensions expected by the model -> checked before solves and simulations
+        void check_model() const {
+            if (_x0.size() != _model->n_state()) {
+                throw std::invalid_argument("Model '" + _model->name() + "' has " + std::to_string(_model->n_state()) +
+                                            " states, got x0 of size " + std::to_string(_x0.size()));
+            };
+            if (_p_const.size() != _model->n_const()) {
+                throw std::invalid_argument("Model '" + _model->name() + "' has " + std::to_string(_model->n_const()) +
+                                            " constants, got p_const of size " + std::to_string(_p_const.size()));
+            };
+            if (_events && _w_scenarios.size() > 0) {
+                throw std::invalid_argument("Event-located steps do not support scenarios -> clear them first");
+            };
+            if (_events && _model->sharpness().empty()) {
+                throw std::invalid_argument("Event-located steps need the sharpness constants of model '" +
+                                            _model->name() + "' (Model::sharpness)");
+            };
+        };
         // Integrate model from t1 to t2
         vector<double> integrate(const double t1, const double t2, const double dt, const vector<double> x0) {
-            //runge_kutta_dopri5<vector<double>, double, vector<double>, double, openmp_range_algebra> rk5_stepper;
-            runge_kutta_dopri5<vector<double>> rk5_stepper;
+            TRACE_SCOPE("integrate", "integration");
             vector<double> x(x0);
-            size_t steps = integrate_const(rk5_stepper,
-                                           [&] (const vector<double> &x , vector<double> &dxdt, const double t) {
-                                               model(x, dxdt, t, _p_dynamic, _p_opt, _p_const);
-                                           }, x, t1, t2, dt);
+            PriceCurve<double> prices(_p_dynamic, _price_index, _price_table.get());
+            uint64_t _rhs = 0;
+            size_t steps = _model->integrate(x, t1, t2, dt, prices, _p_opt, _p_const, _rhs);
+            STATS_ADD(_telemetry, rhs_evaluations, _rhs);
+            STATS_ADD(_telemetry, integration_steps, steps);
             return x;
         };
-        // Objective function wrapper -> p_dynamic and x0 are include as dynamic parameters in CppAD!
+        /*
+         * Simulate from _t0, _x0 under the schedule p_opt and store the state at every point of t_grid
+         * ... a single integration with dense output (adaptive dopri5), out is row-major len(t_grid) x n_state
+         */
+        double _sim_abs_tol = 1e-8;
+        double _sim_rel_tol = 1e-8;
+        void simulate(const vector_ref<double> &p_opt, const vector_ref<double> &t_grid, double *out) {
+            if (t_grid.size() == 0) { return; };
+            check_model();
+            TRACE_SCOPE("simulate", "integration");
+            for(int k = 1; k < t_grid.size(); ++k) {
+                if (t_grid(k) < t_grid(k - 1)) { throw std::invalid_argument("t_grid must be non-decreasing"); };
+            };
+            if (t_grid(0) < _t0) { throw std::invalid_argument("t_grid must start at or after t0"); };
+            vector<double> _p_opt(p_opt);
+            Eigen::Map<matrix<double>> _out(out, t_grid.size(), _x0.size());
+            // integrate_times starts at the first time -> prepend t0 and skip its observation
+            std::vector<double> _times;
+            _times.reserve(t_grid.size() + 1);
+            _times.push_back(_t0);
+            _times.insert(_times.end(), t_grid.data(), t_grid.data() + t_grid.size());
+            int _row = -1;
+            vector<double> x(_x0);
+            PriceCurve<double> prices(_p_dynamic, _price_index, _price_table.get());
+            uint64_t _rhs = 0;
+            size_t steps = _model->integrate_dense(x, _times, _dt, _sim_abs_tol, _sim_rel_tol, prices, _p_opt, _p_const,
+                                                   [&] (const vector_ref<double> &x, const double t) {
+                                                       if (_row >= 0) { _out.row(_row) = x.transpose(); };
+                                                       _row += 1;
+                                                   }, _rhs);
+            STATS_ADD(_telemetry, rhs_evaluations, _rhs);
+            STATS_ADD(_telemetry, integration_steps, steps);
+        };
+        // One simulation per row of p_opts -> out is row-major rows(p_opts) x len(t_grid) x n_state
+        void simulate_batch(const matrix_ref<double> &p_opts, const vector_ref<double> &t_grid, double *out) {
+            check_batch(p_opts);
+            size_t _stride = t_grid.size() * _x0.size();
+            parallel_for(p_opts.rows(), _batch_threads, [&] (size_t k, size_t thread) {
+                simulate(p_opts.row(k).transpose(), t_grid, out + k * _stride);
+            });
+        };
+        // Objective function wrapper -> p_dynamic, x0 and p_const are include as dynamic parameters in CppAD!
         template <typename scalar>
         scalar objective_wrapper(const vector<scalar> &p_dynamic_x0, const vector<scalar> &p_opt) {
-            //runge_kutta_dopri5<vector<scalar>, double, vector<scalar>, double, openmp_range_algebra> rk5_stepper;
-            runge_kutta_dopri5<vector<scalar>> rk5_stepper;
-            vector<scalar> x = vector<scalar>::Zero(_x0.size());
-            // x0 is appended to p_dynamic -> treated as dynamical parameters in CppAD!
-            for(int k = 0; k < _x0.size(); ++k) { x(k) = p_dynamic_x0(p_dynamic_x0.size() - _x0.size() + k); };
-            size_t steps = integrate_const(rk5_stepper,
-                                           [&] (const vector<scalar> &x , vector<scalar> &dxdt , const double t) {
-                                               model(x, dxdt, t, p_dynamic_x0, p_opt, _p_const);
-                                           }, x, _t0, _tf, _dt);
-            return objective(x, p_dynamic_x0, p_opt, _p_const);
-        };
-        // Overloading -> used in IPOPT function
+            TRACE_SCOPE("objective", "integration");
+            // x0 and p_const are appended to p_dynamic -> treated as dynamical parameters in CppAD!
+            size_t _n_dynamic = p_dynamic_x0.size() - _x0.size() - _p_const.size();
+            vector<scalar> x = p_dynamic_x0.segment(_n_dynamic, _x0.size());
+            vector<scalar> p_const = p_dynamic_x0.tail(_p_const.size());
+            if (_events) {
+                EventPlan _local;
+                const EventPlan *_plan = &_event_plan;
+                if constexpr (std::is_same<scalar, double>::value) {
+                    // The plan of the tape while the order is the same -> consistent with the gradient
+                    if (!event_plan_matches(_event_plan, p_dynamic_x0, p_opt)) {
+                        _local = event_plan(p_dynamic_x0, p_opt);
+                        _plan = &_local;
+                    };
+                };
+                x = integrate_events(*_plan, p_dynamic_x0, p_opt, p_const, x);
+                return objective(x, p_dynamic_x0, p_opt, p_const);
+            };
+            PriceCurve<scalar> prices(p_dynamic_x0, _price_index);
+            prices.window_sharpness = _tape_sharpness;
+            uint64_t _rhs = 0;
+            size_t steps = _model->integrate(x, _t0, _tf, _dt, prices, p_opt, p_const, _rhs);
+            STATS_ADD(_telemetry, rhs_evaluations, _rhs);
+            STATS_ADD(_telemetry, integration_steps, steps);
+            return objective(x, p_dynamic_x0, p_opt, p_const);
+        };
+        // Overloading -> used in IPOPT function (allocation free once the workspace of the thread is sized)
         double objective_wrapper(const vector<double> &p_opt) {
-            runge_kutta_dopri5<vector<double>> rk5_stepper;
-            vector<double> x(_x0);
-            size_t steps = integrate_const(rk5_stepper,
-                                           [&] (const vector<double> &x , vector<double> &dxdt , const double t) {
-                                               model(x, dxdt, t, _p_dynamic, p_opt, _p_const);
-                                           }, x, _t0, _tf, _dt);
+            if (_w_scenarios.size() > 0) { return scenario_objective(p_opt); };
+            if (_events) { return objective_wrapper(dynamic_parameters(_p_dynamic), p_opt); };
+            TRACE_SCOPE("objective", "integration");
+            Workspace &_ws = workspace();
+            vector<double> &x = _ws.x;
+            x = _x0;
+            PriceCurve<double> prices(_p_dynamic, _price_index, _price_table.get(), &_ws.prefix);
+            uint64_t _rhs = 0;
+            size_t steps = _model->integrate(x, _t0, _tf, _dt, prices, p_opt, _p_const, _rhs);
+            STATS_ADD(_telemetry, rhs_evaluations, _rhs);
+            STATS_ADD(_telemetry, integration_steps, steps);
             return objective(x, _p_dynamic, p_opt, _p_const);
         };
-        // Jacobian function wrapper
-        vector<double> jacobian(const vector<double> &p_opt) {
+        Workspace &workspace() { return _workspaces[thread_number()]; };
+        /*
+         * Event-located integration -> segment i of the plan runs from a to b (event times, t0 and tf) and is
+         * integrated in its own time tau in [0, 1], t = a + tau * (b - a), with plan.steps[i] fixed dopri5 steps. The
+         * segment ends are functions of p_opt, so they move with the switch times on the tape. The model only sees
+         * time as sharpness * (t - time) (switch and price times, sharpness constants of Model::sharpness), hence
+         * shifting those times by a, dividing them by b - a and scaling the sharpness by b - a gives the model in tau.
+         * Price intervals beyond the reach of a segment (lo, hi of the plan) are saturated -> their capped constant is
+         * added to the curve instead, as in PriceCurve::evaluate.
+         */
+        template <typename scalar>
+        vector<scalar> integrate_events(const EventPlan &plan, const vector<scalar> &p_dynamic,
+                                        const vector<scalar> &p_opt, const vector<scalar> &p_const, vector<scalar> x) {
+            TRACE_SCOPE("integrate_events", "integration");
+            int n = _price_index.n;
+            std::vector<int> _sharpness = _model->sharpness();
+            scalar _a = _t0;
+            for(size_t i = 0; i < plan.steps.size(); ++i) {
+                scalar _b = i < plan.order.size() ? event_time(plan.order[i], p_dynamic, p_opt, plan.width) : scalar(_tf);
+                scalar _length = _b - _a;
+                scalar _scale = at_least(_length, 1e-12); // Coinciding events -> the segment has no effect
+                vector<scalar> _p_opt(p_opt.size());
+                for(int k = 0; k < p_opt.size(); ++k) { _p_opt(k) = (p_opt(k) - _a) / _scale; };
+                vector<scalar> _p_const = p_const;
+                for(int k : _sharpness) { _p_const(k) *= _scale; };
+                int _m = plan.hi[i] - plan.lo[i] + 1;
+                vector<scalar> _curve(2 * _m + 1);
+                for(int k = 0; k < _m; ++k) { _curve(k) = p_dynamic(plan.lo[i] + k); };
+                for(int k = 0; k <= _m; ++k) { _curve(_m + k) = (p_dynamic(n + plan.lo[i] + k) - _a) / _scale; };
+                PriceIndex _index;
+                _index.n = _m;
+                _index.full = true;
+                PriceCurve<scalar> prices(_curve, _index);
+                for(int k = 0; k < n; ++k) {
+                    if (k < plan.lo[i] || k > plan.hi[i]) { prices.saturated += p_dynamic(k); };
+                };
+                prices.saturated /= 1. + std::exp(sigmoid_cap);
+                uint64_t _rhs = 0;
+                size_t steps = _model->integrate_steps(x, 0., 1. / plan.steps[i], plan.steps[i], &_length, prices,
+                                                       _p_opt, _p_const, _rhs);
+                STATS_ADD(_telemetry, rhs_evaluations, _rhs);
+                STATS_ADD(_telemetry, integration_steps, steps);
+                _a = _b;
+            };
+            return x;
+        };
+        double event_width() const {
+            if (_event_width > 0.) { return _event_width; };
+            double _floor = sharpness_floor();
+            return _floor > 0. ? 4. / _floor : _dt;
+        };
+        // Time of an event -> p_dynamic holds (prices; times) in front (the dynamical parameters do as well)
+        template <typename scalar>
+        scalar event_time(const int id, const vector<scalar> &p_dynamic, const vector<scalar> &p_opt,
+                          const double width) const {
+            int n_p = p_opt.size();
+            if (id < 3 * n_p) { return p_opt(id / 3) + (id % 3 - 1) * width; };
+            return p_dynamic(_price_index.n + id - 3 * n_p);
+        };
+        // Events inside (t0, tf) sorted by time
+        std::vector<int> event_order(const vector<double> &p_dynamic, const vector<double> &p_opt,
+                                     const double width) const {
+            std::vector<std::pair<double, int>> _events;
+            int n_ids = 3 * p_opt.size() + _price_index.n + 1;
+            for(int id = 0; id < n_ids; ++id) {
+                double _t = event_time(id, p_dynamic, p_opt, width);
+                if (_t > _t0 && _t < _tf) { _events.emplace_back(_t, id); };
+            };
+            std::sort(_events.begin(), _events.end());
+            std::vector<int> _out(_events.size());
+            for(size_t k = 0; k < _events.size(); ++k) { _out[k] = _events[k].second; };
+            return _out;
+        };
+        EventPlan event_plan(const vector<double> &p_dynamic, const vector<double> &p_opt) const {
+            EventPlan _out;
+            _out.t0 = _t0; _out.tf = _tf; _out.dt = _dt; _out.width = event_width(); _out.window_steps = _event_steps;
+            _out.order = event_order(p_dynamic, p_opt, _out.width);
+            int n = _price_index.n;
+            double _floor = sharpness_floor();
+            double _a = _t0;
+            for(size_t i = 0; i <= _out.order.size(); ++i) {
+                double _b = i < _out.order.size() ? event_time(_out.order[i], p_dynamic, p_opt, _out.width) : _tf;
+                double _mid = 0.5 * (_a + _b);
+                // Base step dt, finer inside the window of a switch time
+                int _steps = std::max(1, (int) std::ceil((_b - _a) / _dt - 1e-9));
+                for(int k = 0; k < p_opt.size(); ++k) {
+                    if (std::abs(_mid - p_opt(k)) < _out.width) {
+                        _steps = std::max(_steps, (int) std::ceil(_event_steps * (_b - _a) / _out.width - 1e-9));
+                    };
+                };
+                _out.steps.push_back(_steps);
+                // The segment stays inside its price interval k (the price times are events) -> neighbours in reach
+                int _k = _price_index.locate(_mid);
+                if (_floor > 0.) {
+                    double _reach = PriceCurve<double>::window_exponent / _floor;
+                    _out.lo.push_back(_price_index.locate(p_dynamic(n + _k) - _reach));
+                    _out.hi.push_back(_price_index.locate(p_dynamic(n + _k + 1) + _reach));
+                } else {
+                    _out.lo.push_back(0);
+                    _out.hi.push_back(n - 1);
+                };
+                _a = _b;
+            };
+            return _out;
+        };
+        // Same settings and event order as the plan -> checked in place (no sort), record_tape calls it every time
+        bool event_plan_matches(const EventPlan &plan, const vector<double> &p_dynamic,
+                                const vector<double> &p_opt) const {
+            double _width = event_width();
+            if (plan.steps.empty() || plan.t0 != _t0 || plan.tf != _tf || plan.dt != _dt || plan.width != _width ||
+                plan.window_steps != _event_steps) { return false; };
+            // The plan's events are inside (t0, tf) and sorted by (time, id) as in event_order ...
+            for(size_t k = 0; k < plan.order.size(); ++k) {
+                double _t = event_time(plan.order[k], p_dynamic, p_opt, _width);
+                if (!(_t > _t0 && _t < _tf)) { return false; };
+                if (k > 0) {
+                    double _before = event_time(plan.order[k - 1], p_dynamic, p_opt, _width);
+                    if (_t < _before || (_t == _before && plan.order[k] < plan.order[k - 1])) { return false; };
+                };
+            };
+            // ... and no other event is
+            size_t _inside = 0;
+            int n_ids = 3 * p_opt.size() + _price_index.n + 1;
+            for(int id = 0; id < n_ids; ++id) {
+                double _t = event_time(id, p_dynamic, p_opt, _width);
+                if (_t > _t0 && _t < _tf) { _inside += 1; };
+            };
+            return _inside == plan.order.size();
+        };
+        // Dynamical parameters as seen by the tape -> p_dynamic with x0 and p_const appended
+        vector<double> dynamic_parameters(const vector<double> &p_dynamic) const {
+            vector<double> _out = vector<double>::Zero(p_dynamic.size() + _x0.size() + _p_const.size());
+            _out.head(p_dynamic.size()) = p_dynamic;
+            _out.segment(p_dynamic.size(), _x0.size()) = _x0;
+            _out.tail(_p_const.size()) = _p_const;
+            return _out;
+        };
+        /*
+         * Smallest sigmoid sharpness of the model -> the price window of a tape is sized for the sharpness at recording,
+         * so smoother values than that need a new recording (sharper ones are served by the recorded window)
+         */
+        double sharpness_floor() const {
+            double _out = std::numeric_limits<double>::infinity();
+            for(int i : _model->sharpness()) {
+                if (i < _p_const.size() && _p_const(i) > 0.) { _out = std::min(_out, _p_const(i)); };
+            };
+            return std::isinf(_out) ? 0. : _out;
+        };
+        // Record the objective tape if needed
+        void record_tape(const vector<double> &p_opt) {
+            // p_const only changes together with new_dynamic -> no sharpness scan in steady-state iterations
+            if (!new_tape && new_dynamic && sharpness_floor() < _tape_sharpness) { new_tape = true; };
+            if (!new_tape && _events && !event_plan_matches(_event_plan, _p_dynamic, p_opt)) { new_tape = true; };
             if (new_tape) {
+                TRACE_SCOPE("record_tape", "tape");
+                STATS_TIMER(_telemetry, tape_seconds);
+                if (!cppad_in_parallel()) { hold_memory(); };
+                STATS_ADD(_telemetry, tape_recordings, 1);
+                _tape_sharpness = sharpness_floor();
+                if (_events) { _event_plan = event_plan(_p_dynamic, p_opt); };
                 // Fill dynamical parameters
-                vector<ad_double> p_dynamic_x0 = vector<ad_double>::Zero(_p_dynamic.size() + _x0.size());
-                for(int k = 0; k < _p_dynamic.size(); ++k) { p_dynamic_x0(k) = _p_dynamic(k); };
-                for(int k = 0; k < _x0.size(); ++k) { p_dynamic_x0(p_dynamic_x0.size() - _x0.size() + k) = _x0(k); };
+                vector<double> _values = dynamic_parameters(_p_dynamic);
+                vector<ad_double> p_dynamic_x0 = vector<ad_double>::Zero(_values.size());
+                for(int k = 0; k < _values.size(); ++k) { p_dynamic_x0(k) = _values(k); };
                 // Fill independent parameters
                 vector<ad_double> p_indep = vector<ad_double>::Zero(p_opt.size());
                 for(int k = 0; k < p_opt.size(); ++k) { p_indep(k) = p_opt(k); };
@@ -168,16 +1088,288 @@ namespace SwitchingTimes {
                 _out(0) = objective_wrapper(p_dynamic_x0, p_indep);
                 objective_tape = ad_function(p_indep, _out);
                 new_tape = false;
+                tape_version += 1;
             };
-            if (new_dynamic) {
-                vector<double> p_dynamic_x0 = vector<double>::Zero(_p_dynamic.size() + _x0.size());
-                for(int k = 0; k < _p_dynamic.size(); ++k) { p_dynamic_x0(k) = _p_dynamic(k); };
-                for(int k = 0; k < _x0.size(); ++k) { p_dynamic_x0(p_dynamic_x0.size() - _x0.size() + k) = _x0(k); };
-                objective_tape.new_dynamic(p_dynamic_x0);
-                new_dynamic = false;
-            };
+        };
+        // Take over the tape of a plant of the same configuration and size instead of recording one
+        void share_tape(const Plant &other) {
+            objective_tape = other.objective_tape;
+            new_tape = other.new_tape;
+            new_dynamic = true; // The dynamical parameters of the tape are those of other
+            tape_version += 1;
+            _tape_sharpness = other._tape_sharpness;
+            _event_plan = other._event_plan;
+        };
+        // Jacobian function wrapper
+        vector<double> jacobian(const vector<double> &p_opt) {
+            TRACE_SCOPE("jacobian", "tape");
+            record_tape(p_opt);
+            if (_w_scenarios.size() > 0) { return scenario_jacobian(p_opt); };
+            update_dynamic();
             return objective_tape.Jacobian(p_opt);
         };
+        // Jacobian into grad -> forward/reverse sweep on workspace vectors, no allocation in steady state
+        void jacobian(const vector<double> &p_opt, double *grad) {
+            if (_w_scenarios.size() > 0) {
+                vector<double> _grad = jacobian(p_opt);
+                for(int k = 0; k < p_opt.size(); ++k) { grad[k] = _grad(k); };
+                return;
+            };
+            TRACE_SCOPE("jacobian", "tape");
+            record_tape(p_opt);
+            update_dynamic();
+            Workspace &_ws = workspace();
+            _ws.u.resize(p_opt.size());
+            for(int k = 0; k < p_opt.size(); ++k) { _ws.u[k] = p_opt(k); };
+            _ws.w.resize(1);
+            _ws.w[0] = 1.;
+            objective_tape.Forward(0, _ws.u);
+            CppAD::vector<double> _grad = objective_tape.Reverse(1, _ws.w);
+            for(int k = 0; k < p_opt.size(); ++k) { grad[k] = _grad[k]; };
+        };
+        // Load the current dynamical parameters into objective_tape (if they changed)
+        void update_dynamic() {
+            if (!new_dynamic) { return; };
+            STATS_ADD(_telemetry, new_dynamic_calls, 1);
+            objective_tape.new_dynamic(dynamic_parameters(_p_dynamic));
+            new_dynamic = false;
+            dynamic_version += 1;
+        };
+        /*
+         * Per-thread copies of objective_tape
+         *
+         * An ADFun object can only be used by one thread at a time, so parallel evaluations share the recorded tape
+         * through copies. A copy is made by the thread that uses it (CppAD memory stays thread local) and only
+         * after a new recording. reserve_thread_tapes must be called before entering the parallel region.
+         */
+        void reserve_thread_tapes() {
+            thread_tapes.resize(max_threads());
+            thread_tape_version.resize(max_threads(), 0);
+            thread_dynamic_version.resize(max_threads(), unknown_dynamic);
+        };
+        // Copy for callers that load their own dynamical parameters (scenarios, batches)
+        ad_function &thread_tape(const size_t thread) {
+            if (thread_tape_version[thread] != tape_version) {
+                thread_tapes[thread] = objective_tape;
+                thread_tape_version[thread] = tape_version;
+            };
+            thread_dynamic_version[thread] = unknown_dynamic;
+            return thread_tapes[thread];
+        };
+        /*
+         * Copy with the plant's dynamical parameters -> loaded only when they changed since the copy last had them.
+         * update_dynamic must be called (outside of the parallel region) before.
+         */
+        ad_function &dynamic_thread_tape(const size_t thread) {
+            if (thread_tape_version[thread] != tape_version) {
+                thread_tapes[thread] = objective_tape; // Carries the dynamical parameters of objective_tape
+                thread_tape_version[thread] = tape_version;
+                thread_dynamic_version[thread] = dynamic_version;
+            } else if (thread_dynamic_version[thread] != dynamic_version) {
+                STATS_ADD(_telemetry, new_dynamic_calls, 1);
+                thread_tapes[thread].new_dynamic(dynamic_parameters(_p_dynamic));
+                thread_dynamic_version[thread] = dynamic_version;
+            };
+            return thread_tapes[thread];
+        };
+        static constexpr size_t unknown_dynamic = std::numeric_limits<size_t>::max();
+        /*
+         * Scenario mode -> weighted sum over the rows of _p_scenarios
+         *
+         * Scenarios only differ in the dynamical parameters, so the single recorded tape is shared: every thread
+         * evaluates a batch of scenarios on its own tape copy by switching dynamical parameters with new_dynamic.
+         * Terms are kept per scenario and summed in scenario order -> the result does not depend on which thread
+         * took which scenario (the last bits of f and its gradient steer IPOPT's line search).
+         */
+        double scenario_objective(const vector<double> &p_opt) {
+            vector<double> _terms(_p_scenarios.rows());
+            parallel_for(_p_scenarios.rows(), _scenario_threads, [&] (size_t k, size_t thread) {
+                vector<double> _p_dynamic_x0 = dynamic_parameters(_p_scenarios.row(k).transpose());
+                _terms(k) = _w_scenarios(k) * objective_wrapper(_p_dynamic_x0, p_opt);
+            });
+            double _out = 0.;
+            for(int k = 0; k < _terms.size(); ++k) { _out += _terms(k); };
+            return _out;
+        };
+        vector<double> scenario_jacobian(const vector<double> &p_opt) {
+            reserve_thread_tapes();
+            matrix<double> _terms(_p_scenarios.rows(), p_opt.size());
+            parallel_for(_p_scenarios.rows(), _scenario_threads, [&] (size_t k, size_t thread) {
+                _terms.row(k) = _w_scenarios(k) * scenario_gradient(thread_tape(thread), k, p_opt).transpose();
+            });
+            vector<double> _out = vector<double>::Zero(p_opt.size());
+            for(int k = 0; k < _terms.rows(); ++k) { _out += _terms.row(k).transpose(); };
+            return _out;
+        };
+        vector<double> scenario_gradient(ad_function &tape, const int k, const vector<double> &p_opt) {
+            TRACE_SCOPE("scenario_gradient", "tape");
+            STATS_ADD(_telemetry, new_dynamic_calls, 1);
+            tape.new_dynamic(dynamic_parameters(_p_scenarios.row(k).transpose()));
+            return tape.Jacobian(p_opt);
+        };
+        /*
+         * Batch evaluation -> one candidate schedule per row of p_opts, rows are evaluated in parallel
+         */
+        size_t _batch_threads = max_threads();
+        // One schedule of the plant's size per row -> another width would retape or overrun the workspaces
+        void check_batch(const matrix_ref<double> &p_opts) const {
+            if (p_opts.cols() != _p_opt.size()) {
+                throw std::invalid_argument("Expected one schedule of " + std::to_string(_p_opt.size()) +
+                                            " switch times per row, got " + std::to_string(p_opts.cols()) + " columns");
+            };
+        };
+        vector<double> evaluate(const matrix_ref<double> &p_opts) {
+            check_model();
+            check_batch(p_opts);
+            vector<double> _out = vector<double>::Zero(p_opts.rows());
+            parallel_for(p_opts.rows(), _batch_threads, [&] (size_t k, size_t thread) {
+                _out(k) = objective_wrapper(vector<double>(p_opts.row(k).transpose()));
+            });
+            return _out;
+        };
+        matrix<double> gradient(const matrix_ref<double> &p_opts) {
+            matrix<double> _out = matrix<double>::Zero(p_opts.rows(), p_opts.cols());
+            if (p_opts.rows() == 0) { return _out; };
+            check_model();
+            check_batch(p_opts);
+            if (_events) {
+                // Rows with another event order need their own recording -> sequential
+                for(int k = 0; k < p_opts.rows(); ++k) { _out.row(k) = jacobian(p_opts.row(k).transpose()).transpose(); };
+                return _out;
+            };
+            record_tape(p_opts.row(0).transpose());
+            reserve_thread_tapes();
+            std::vector<char> _loaded(max_threads(), 0);
+            vector<double> _p_dynamic_x0 = dynamic_parameters(_p_dynamic);
+            parallel_for(p_opts.rows(), _batch_threads, [&] (size_t k, size_t thread) {
+                ad_function &_tape = thread_tape(thread);
+                vector<double> _p_opt = p_opts.row(k).transpose();
+                if (_w_scenarios.size() > 0) {
+                    vector<double> _grad = vector<double>::Zero(_p_opt.size());
+                    for(int j = 0; j < _w_scenarios.size(); ++j) {
+                        _grad += _w_scenarios(j) * scenario_gradient(_tape, j, _p_opt);
+                    };
+                    _out.row(k) = _grad.transpose();
+                    return;
+                };
+                if (!_loaded[thread]) {
+                    STATS_ADD(_telemetry, new_dynamic_calls, 1);
+                    _tape.new_dynamic(_p_dynamic_x0);
+                    _loaded[thread] = 1;
+                };
+                _out.row(k) = _tape.Jacobian(_p_opt).transpose();
+            });
+            return _out;
+        };
+        /*
+         * Progress reporting shared by both backends -> returns false if the solve should stop
+         */
+        void start_progress() {
+            _telemetry.reset();
+            _iterations = 0;
+            TRACE_MARK(_trace_mark);
+            _progress_history.clear();
+            _stopped_early = false;
+            _journal.clear();
+            _solve_start = std::chrono::steady_clock::now();
+        };
+        bool report_progress(const int iteration, const double obj_value, const double inf_pr, const double inf_du) {
+            bool _continue = true;
+            _iterations = iteration;
+            if (_callback) {
+                std::chrono::duration<double> _elapsed = std::chrono::steady_clock::now() - _solve_start;
+                _continue = _callback(Progress{iteration, obj_value, inf_pr, inf_du, _elapsed.count()});
+            };
+            if (_stall_tol > 0.) {
+                _progress_history.push_back(obj_value);
+                if ((int) _progress_history.size() > _stall_iter) {
+                    double _improvement = _progress_history.front() - obj_value;
+                    _progress_history.pop_front();
+                    if (inf_pr <= _stall_inf_pr && _improvement < _stall_tol * std::max(1., std::abs(obj_value))) {
+                        _continue = false;
+                    };
+                };
+            };
+            if (!_continue) { _stopped_early = true; };
+            return _continue;
+        };
+        /*
+         * Native bound-constrained solve (alternative to IPOPT)
+         *
+         * The schedule is reparameterized as durations z = (ON_1, ON_1 length, OFF_1 length, ON_2 length, ...) so
+         * the linear constraints from eval_g become simple bounds on z. The switch times are the cumulative sum of
+         * z, hence the gradient w.r.t. z is the reverse cumulative sum of the (taped) gradient w.r.t. the switch
+         * times. The variable bounds on the switch times (except ON_1) are no longer simple bounds and are
+         * enforced by a quadratic penalty. No multipliers are returned (get_z_L, get_z_U and get_lambda are empty).
+         */
+        double _bound_penalty = 1e3;
+        void durations_to_switch_times(const vector<double> &z, vector<double> &p_opt) const {
+            int _tmp = z.size() / 2;
+            double _t = 0.;
+            for(int k = 0; k < z.size(); ++k) {
+                _t += z(k);
+                if (k % 2 == 0) { p_opt(k / 2) = _t; } else { p_opt(_tmp + k / 2) = _t; };
+            };
+        };
+        void solve_lbfgsb(LBFGSB &solver) {
+            int _tmp = _p_opt.size() / 2;
+            int n = _p_opt.size();
+            // Starting point and bounds in the duration parameterization
+            vector<double> z = vector<double>::Zero(n);
+            vector<double> z_l = vector<double>::Zero(n);
+            vector<double> z_u = vector<double>::Zero(n);
+            double _prev = 0.;
+            for(int k = 0; k < n; ++k) {
+                double _t = (k % 2 == 0) ? _p_opt(k / 2) : _p_opt(_tmp + k / 2);
+                z(k) = _t - _prev;
+                _prev = _t;
+                if (k == 0) {
+                    z_l(k) = _lower_bound(0); z_u(k) = _upper_bound(0);
+                } else if (k % 2 == 1) {
+                    z_l(k) = _on_bound(0); z_u(k) = _on_bound(1);
+                } else {
+                    z_l(k) = _off_bound(0); z_u(k) = _off_bound(1);
+                };
+            };
+            vector<double> p_opt = vector<double>::Zero(n);
+            LBFGSB::function fg = [&] (const vector<double> &_z, vector<double> &grad_z) {
+                durations_to_switch_times(_z, p_opt);
+                STATS_ADD(_telemetry, eval_f_calls, 1);
+                STATS_ADD(_telemetry, eval_grad_f_calls, 1);
+                double _out;
+                vector<double> _grad;
+                {
+                    STATS_TIMER(_telemetry, eval_f_seconds);
+                    _out = objective_wrapper(p_opt);
+                }
+                {
+                    STATS_TIMER(_telemetry, eval_grad_f_seconds);
+                    _grad = jacobian(p_opt);
+                }
+                for(int k = 0; k < n; ++k) {
+                    double _below = _lower_bound(k) - p_opt(k);
+                    double _above = p_opt(k) - _upper_bound(k);
+                    if (_below > 0.) { _out += _bound_penalty * _below * _below; _grad(k) -= 2. * _bound_penalty * _below; };
+                    if (_above > 0.) { _out += _bound_penalty * _above * _above; _grad(k) += 2. * _bound_penalty * _above; };
+                };
+                // Reverse cumulative sum over the temporal ordering (ON_1, OFF_1, ON_2, ...)
+                double _sum = 0.;
+                for(int k = n - 1; k >= 0; --k) {
+                    _sum += (k % 2 == 0) ? _grad(k / 2) : _grad(_tmp + k / 2);
+                    grad_z(k) = _sum;
+                };
+                return _out;
+            };
+            _status_init = 0;
+            start_progress();
+            _status_solve = (int) solver.minimize(fg, z, z_l, z_u, [&] (int iteration, double f, double pg) {
+                return report_progress(iteration, f, 0., pg);
+            });
+            durations_to_switch_times(z, _p_opt_ipopt);
+            _objective = objective_wrapper(_p_opt_ipopt);
+            // The penalized duration problem has no multipliers of the IPOPT formulation -> none are reported
+            _z_L.resize(0); _z_U.resize(0); _lambda.resize(0);
+        };
         /*
          * IPOPT functions below
          */
@@ -242,8 +1434,11 @@ namespace SwitchingTimes {
                 Number&       obj_value
         )
         {
-            vector<double> p_opt = vector<double>::Zero(_p_opt.size());
-            for(int k = 0; k < _p_opt.size(); ++k) { p_opt(k) = x[k]; };
+            TRACE_CALLBACK("eval_f", _trace_mark);
+            STATS_ADD(_telemetry, eval_f_calls, 1);
+            STATS_TIMER(_telemetry, eval_f_seconds);
+            vector<double> &p_opt = workspace().p_opt;
+            p_opt = Eigen::Map<const vector<double>>(x, _p_opt.size());
             obj_value = objective_wrapper(p_opt);
             return true;
         };
@@ -254,10 +1449,12 @@ namespace SwitchingTimes {
                 Number*       grad_f
         )
         {
-            vector<double> p_opt = vector<double>::Zero(_p_opt.size());
-            for(int k = 0; k < p_opt.size(); ++k) { p_opt(k) = x[k]; };
-            vector<double> _grad = jacobian(p_opt);
-            for(int k = 0; k < p_opt.size(); ++k) { grad_f[k] = _grad(k); };
+            TRACE_CALLBACK("eval_grad_f", _trace_mark);
+            STATS_ADD(_telemetry, eval_grad_f_calls, 1);
+            STATS_TIMER(_telemetry, eval_grad_f_seconds);
+            vector<double> &p_opt = workspace().p_opt;
+            p_opt = Eigen::Map<const vector<double>>(x, _p_opt.size());
+            jacobian(p_opt, grad_f);
             return true;
         };
         bool eval_g(
@@ -268,6 +1465,8 @@ namespace SwitchingTimes {
                 Number*       g
         )
         {
+            TRACE_CALLBACK("eval_g", _trace_mark);
+            STATS_ADD(_telemetry, eval_g_calls, 1);
             int _tmp = _p_opt.size() / 2;
             for(int k = 0; k < _tmp; ++k) { g[k] = x[_tmp + k] - x[k]; };
             for(int k = 0; k < _tmp - 1; ++k) { g[_tmp + k] = x[k + 1] - x[_tmp + k]; };
@@ -284,6 +1483,8 @@ namespace SwitchingTimes {
                 Number*       values
         )
         {
+            TRACE_CALLBACK("eval_jac_g", _trace_mark);
+            STATS_ADD(_telemetry, eval_jac_g_calls, 1);
             if( values == NULL )
             {
                 int _tmp = _p_opt.size() / 2;
@@ -320,6 +1521,26 @@ namespace SwitchingTimes {
             };
             return true;
         };
+        bool intermediate_callback(
+                AlgorithmMode              mode,
+                Index                      iter,
+                Number                     obj_value,
+                Number                     inf_pr,
+                Number                     inf_du,
+                Number                     mu,
+                Number                     d_norm,
+                Number                     regularization_size,
+                Number                     alpha_du,
+                Number                     alpha_pr,
+                Index                      ls_trials,
+                const IpoptData*           ip_data,
+                IpoptCalculatedQuantities* ip_cq
+        )
+        {
+            TRACE_CALLBACK("intermediate_callback", _trace_mark);
+            TRACE_INSTANT("iteration", "solver", "iter", iter);
+            return report_progress(iter, obj_value, inf_pr, inf_du);
+        };
         bool eval_h(
                 Index         n,
                 const Number* x,
@@ -334,6 +1555,8 @@ namespace SwitchingTimes {
                 Number*       values
         )
         {
+            TRACE_CALLBACK("eval_h", _trace_mark);
+            STATS_ADD(_telemetry, eval_h_calls, 1);
             return true;
         };
         void finalize_solution(
@@ -353,25 +1576,166 @@ namespace SwitchingTimes {
             for(int k = 0; k < _p_opt.size(); ++k) {
                 _p_opt_ipopt(k) = x[k];
             };
+            _objective = obj_value;
+            _z_L = Eigen::Map<const vector<double>>(z_L, n);
+            _z_U = Eigen::Map<const vector<double>>(z_U, n);
+            _lambda = Eigen::Map<const vector<double>>(lambda, m);
+        };
+        /*
+         * Binary serialization of the full plant state -> the tape is stored in CppAD's JSON graph format
+         */
+        std::string serialize(const bool include_tape) {
+            BinaryWriter _writer;
+            _writer.write<uint32_t>(serialization_magic);
+            _writer.write<uint32_t>(serialization_version);
+            _writer.write(_model->name());
+            _writer.write(_p_const); _writer.write(_p_dynamic); _writer.write(_p_opt); _writer.write(_p_opt_ipopt);
+            _writer.write(_lower_bound); _writer.write(_upper_bound); _writer.write(_on_bound); _writer.write(_off_bound);
+            _writer.write(_t0); _writer.write(_tf); _writer.write(_dt);
+            _writer.write<uint8_t>(_events); _writer.write(_event_width); _writer.write(_event_steps);
+            _writer.write(_x0);
+            _writer.write(_status_init); _writer.write(_status_solve); _writer.write(_objective);
+            _writer.write(_z_L); _writer.write(_z_U); _writer.write(_lambda);
+            _writer.write(_p_scenarios); _writer.write(_w_scenarios);
+            bool _tape = include_tape && !new_tape;
+            _writer.write<uint8_t>(_tape);
+            if (_tape) { _writer.write(_tape_sharpness); _writer.write(objective_tape.to_json()); };
+            return _writer.buffer;
+        };
+        void deserialize(const std::string &buffer) {
+            BinaryReader _reader(buffer);
+            if (_reader.read<uint32_t>() != serialization_magic || _reader.read<uint32_t>() != serialization_version) {
+                throw std::invalid_argument("Not a serialized plant (or an incompatible version)");
+            };
+            // Read everything into locals first -> a truncated or corrupt buffer leaves the plant untouched
+            std::string _name;
+            _reader.read(_name);
+            std::shared_ptr<const Model> _model_in = make_model(_name);
+            vector<double> _p_const_in, _p_dynamic_in, _p_opt_in, _p_opt_ipopt_in;
+            vector<double> _lower_bound_in, _upper_bound_in, _on_bound_in, _off_bound_in, _x0_in;
+            vector<double> _z_L_in, _z_U_in, _lambda_in, _w_scenarios_in;
+            matrix<double> _p_scenarios_in;
+            _reader.read(_p_const_in); _reader.read(_p_dynamic_in); _reader.read(_p_opt_in); _reader.read(_p_opt_ipopt_in);
+            _reader.read(_lower_bound_in); _reader.read(_upper_bound_in); _reader.read(_on_bound_in);
+            _reader.read(_off_bound_in);
+            double _t0_in = _reader.read<double>(), _tf_in = _reader.read<double>(), _dt_in = _reader.read<double>();
+            bool _events_in = _reader.read<uint8_t>();
+            double _event_width_in = _reader.read<double>();
+            int _event_steps_in = _reader.read<int>();
+            _reader.read(_x0_in);
+            int _status_init_in = _reader.read<int>(), _status_solve_in = _reader.read<int>();
+            double _objective_in = _reader.read<double>();
+            _reader.read(_z_L_in); _reader.read(_z_U_in); _reader.read(_lambda_in);
+            _reader.read(_p_scenarios_in); _reader.read(_w_scenarios_in);
+            bool _tape = _reader.read<uint8_t>();
+            double _tape_sharpness_in = 0.;
+            ad_function _tape_in;
+            if (_tape) {
+                _tape_sharpness_in = _reader.read<double>();
+                std::string _json;
+                _reader.read(_json);
+                _tape_in.from_json(_json);
+            };
+            // Commit
+            _model = _model_in;
+            _p_const = _p_const_in; _p_dynamic = _p_dynamic_in; _p_opt = _p_opt_in; _p_opt_ipopt = _p_opt_ipopt_in;
+            _lower_bound = _lower_bound_in; _upper_bound = _upper_bound_in;
+            _on_bound = _on_bound_in; _off_bound = _off_bound_in;
+            _t0 = _t0_in; _tf = _tf_in; _dt = _dt_in;
+            _events = _events_in; _event_width = _event_width_in; _event_steps = _event_steps_in;
+            _x0 = _x0_in;
+            _status_init = _status_init_in; _status_solve = _status_solve_in; _objective = _objective_in;
+            _z_L = _z_L_in; _z_U = _z_U_in; _lambda = _lambda_in;
+            _p_scenarios = _p_scenarios_in; _w_scenarios = _w_scenarios_in;
+            update_price_index();
+            _price_table = nullptr;
+            new_tape = true;
+            if (_tape) {
+                objective_tape.swap(_tape_in);
+                _tape_sharpness = _tape_sharpness_in;
+                // The event plan of the tape is not stored -> recorded again at the first use
+                new_tape = _events;
+                tape_version += 1;
+            };
+            new_dynamic = true;
+        };
+    };
+    /*
+     * IPOPT application with the options shared by all problems of this library
+     */
+    inline SmartPtr<IpoptApplication> ipopt_application(const int print_level) {
+        SmartPtr<IpoptApplication> app = IpoptApplicationFactory();
+        std::string tag = "tol";
+        std::string val = "";
+        app->Options()->SetNumericValue(tag, 1e-4);
+        tag = "hessian_approximation";
+        val = "limited-memory";
+        app->Options()->SetStringValue(tag, val);
+        tag = "print_level";
+        app->Options()->SetIntegerValue(tag, print_level);
+        if (print_level == 0) {
+            // Suppress the IPOPT banner as well
+            tag = "sb";
+            val = "yes";
+            app->Options()->SetStringValue(tag, val);
         };
+        return app;
     };
     class NLP {
     public:
         SmartPtr<Plant> plant;
+        std::string _solver = "ipopt"; // Solver backend -> "ipopt" or "lbfgsb"
+        int _print_level = 0;          // IPOPT console print level of solve() -> output goes to the journal
+        int _journal_level = 5;        // IPOPT print level of the in-memory journal (0 disables it)
+        bool _pickle_tape = true;      // Include the objective tape when pickled
+        LBFGSB lbfgsb;
+        std::vector<double> _continuation;        // Sharpness factors of the continuation stages (empty -> off)
+        std::vector<ContinuationStage> _stages;   // Stages of the last continuation solve
         NLP() { plant = new Plant(); };
         // Set functions
-        void set_p_const(const vector<double> &p_const) { (*plant).set_p_const(p_const); };
-        void set_p_dynamic(const vector<double> &p_dynamic) { (*plant).set_p_dynamic(p_dynamic); };
-        void set_p_optimize(const vector<double> &p_opt) { (*plant).set_p_optimize(p_opt); };
+        void set_p_const(const vector_ref<double> &p_const) { (*plant).set_p_const(p_const); };
+        void set_p_dynamic(const vector_ref<double> &p_dynamic) { (*plant).set_p_dynamic(p_dynamic); };
+        void set_p_optimize(const vector_ref<double> &p_opt) { (*plant).set_p_optimize(p_opt); };
         void set_t0(const double t0) { (*plant).set_t0(t0); };
         void set_tf(const double tf) { (*plant).set_tf(tf); };
         void set_dt(const double dt) { (*plant).set_dt(dt); };
-        void set_lower_bound(const vector<double> &lower_bound) { (*plant).set_lower_bound(lower_bound); };
-        void set_upper_bound(const vector<double> &upper_bound) { (*plant).set_upper_bound(upper_bound); };
-        void set_on_bound(const vector<double> &on_bound) { (*plant).set_on_bound(on_bound); };
-        void set_off_bound(const vector<double> &off_bound) { (*plant).set_off_bound(off_bound); };
-        void set_x0(const vector<double> x0) { (*plant).set_x0(x0); };
+        void set_events(const bool events) { (*plant).set_events(events); };
+        void set_event_width(const double width) { (*plant).set_event_width(width); };
+        void set_event_steps(const int steps) { (*plant).set_event_steps(steps); };
+        void set_lower_bound(const vector_ref<double> &lower_bound) { (*plant).set_lower_bound(lower_bound); };
+        void set_upper_bound(const vector_ref<double> &upper_bound) { (*plant).set_upper_bound(upper_bound); };
+        void set_on_bound(const vector_ref<double> &on_bound) { (*plant).set_on_bound(on_bound); };
+        void set_off_bound(const vector_ref<double> &off_bound) { (*plant).set_off_bound(off_bound); };
+        void set_x0(const vector_ref<double> &x0) { (*plant).set_x0(x0); };
+        void set_model(const std::string &name) { (*plant).set_model(name); };
+        void configure(const Spec &spec) { (*plant).configure(spec); };
+        void set_scenarios(const matrix_ref<double> &p_scenarios, const vector_ref<double> &w_scenarios) {
+            (*plant).set_scenarios(p_scenarios, w_scenarios);
+        };
+        void clear_scenarios() { (*plant).clear_scenarios(); };
+        void set_scenario_threads(const size_t threads) { (*plant)._scenario_threads = threads; };
+        void set_batch_threads(const size_t threads) { (*plant)._batch_threads = threads; };
+        void set_callback(const std::function<bool(const Progress &)> &callback) { (*plant)._callback = callback; };
+        void set_stall_tolerance(const double tol, const int iterations) {
+            (*plant)._stall_tol = tol;
+            (*plant)._stall_iter = iterations;
+        };
+        void set_print_level(const int print_level) { _print_level = print_level; };
+        void set_journal_level(const int journal_level) { _journal_level = journal_level; };
+        void set_continuation(const std::vector<double> &factors) {
+            for(double f : factors) {
+                if (!(f > 0.)) { throw std::invalid_argument("Continuation factors must be positive"); };
+            };
+            _continuation = factors;
+        };
+        void set_solver(const std::string &solver) {
+            if (solver != "ipopt" && solver != "lbfgsb") {
+                throw std::invalid_argument("Unknown solver '" + solver + "' -> use 'ipopt' or 'lbfgsb'");
+            };
+            _solver = solver;
+        };
         // Get functions
+        std::string get_model() const { return (*plant).get_model(); };
         const vector<double> &get_p_const() const { return (*plant).get_p_const(); };
         const vector<double> &get_p_dynamic() const { return (*plant).get_p_dynamic(); };
         const vector<double> &get_p_optimize() const { return (*plant).get_p_optimize(); };
@@ -379,6 +1743,9 @@ namespace SwitchingTimes {
         const double &get_t0() const { return (*plant).get_t0(); };
         const double &get_tf() const { return (*plant).get_tf(); };
         const double &get_dt() const { return (*plant).get_dt(); };
+        const bool &get_events() const { return (*plant).get_events(); };
+        const double &get_event_width() const { return (*plant).get_event_width(); };
+        const int &get_event_steps() const { return (*plant).get_event_steps(); };
         const vector<double> &get_x0() const { return (*plant).get_x0(); };
         const vector<double> &get_lower_bound() const { return (*plant).get_lower_bound(); };
         const vector<double> &get_upper_bound() const { return (*plant).get_upper_bound(); };
@@ -386,23 +1753,148 @@ namespace SwitchingTimes {
         const vector<double> &get_off_bound() const { return (*plant).get_off_bound(); };
         const int &get_init_status() const { return (*plant).get_init_status(); };
         const int &get_solve_status() const { return (*plant).get_solve_status(); };
-        // IPOPT wrapper
+        const double &get_objective() const { return (*plant).get_objective(); };
+        const matrix<double> &get_scenarios() const { return (*plant).get_scenarios(); };
+        const vector<double> &get_scenario_weights() const { return (*plant).get_scenario_weights(); };
+        const std::string &get_solver() const { return _solver; };
+        const std::vector<double> &get_continuation() const { return _continuation; };
+        const std::vector<ContinuationStage> &get_continuation_stages() const { return _stages; };
+        const std::string &get_journal() const { return (*plant).get_journal(); };
+        const bool &get_stopped_early() const { return (*plant).get_stopped_early(); };
+        SolveStats get_stats() const { return (*plant).get_stats(); };
+        const vector<double> &get_z_L() const { return (*plant).get_z_L(); };
+        const vector<double> &get_z_U() const { return (*plant).get_z_U(); };
+        const vector<double> &get_lambda() const { return (*plant).get_lambda(); };
+        // Serialization -> plant state followed by the solver settings (the format version is the plant's)
+        std::string serialize(const bool include_tape) const {
+            BinaryWriter _writer;
+            _writer.write((*plant).serialize(include_tape));
+            _writer.write(_solver);
+            _writer.write(_print_level);
+            _writer.write(_journal_level);
+            _writer.write(lbfgsb);
+            _writer.write<uint64_t>(_continuation.size());
+            for(double f : _continuation) { _writer.write(f); };
+            return _writer.buffer;
+        };
+        void deserialize(const std::string &buffer) {
+            // Read everything first -> a truncated buffer leaves the NLP (and its plant) untouched
+            BinaryReader _reader(buffer);
+            std::string _plant, _solver_in;
+            _reader.read(_plant);
+            _reader.read(_solver_in);
+            int _print_level_in = _reader.read<int>();
+            int _journal_level_in = _reader.read<int>();
+            LBFGSB _lbfgsb_in = _reader.read<LBFGSB>();
+            uint64_t _n = _reader.read<uint64_t>();
+            if (_n > (_reader.size - _reader.position) / sizeof(double)) {
+                throw std::runtime_error("Unexpected end of serialized data");
+            };
+            std::vector<double> _continuation_in(_n);
+            for(double &f : _continuation_in) {
+                f = _reader.read<double>();
+                if (!(f > 0.)) { throw std::invalid_argument("Continuation factors must be positive"); };
+            };
+            if (_solver_in != "ipopt" && _solver_in != "lbfgsb") {
+                throw std::invalid_argument("Unknown solver '" + _solver_in + "' -> use 'ipopt' or 'lbfgsb'");
+            };
+            // Plant::deserialize reads its blob completely before it changes the plant
+            (*plant).deserialize(_plant);
+            _solver = _solver_in;
+            _print_level = _print_level_in;
+            _journal_level = _journal_level_in;
+            lbfgsb = _lbfgsb_in;
+            _continuation = _continuation_in;
+            _stages.clear();
+        };
+        // Trajectory simulation -> see Plant::simulate
+        void simulate(const vector_ref<double> &p_opt, const vector_ref<double> &t_grid, double *out) {
+            (*plant).simulate(p_opt, t_grid, out);
+        };
+        void simulate_batch(const matrix_ref<double> &p_opts, const vector_ref<double> &t_grid, double *out) {
+            (*plant).simulate_batch(p_opts, t_grid, out);
+        };
+        size_t n_state() const { return (*plant)._x0.size(); };
+        // Batch evaluation of the objective and its gradient -> one schedule per row
+        vector<double> evaluate(const matrix_ref<double> &p_opts) { return (*plant).evaluate(p_opts); };
+        matrix<double> gradient(const matrix_ref<double> &p_opts) { return (*plant).gradient(p_opts); };
+        // Solver wrapper
         void solve() {
+            if (_continuation.empty()) { solve_plant(plant, _print_level, lbfgsb); } else { solve_continuation(); };
+        };
+        /*
+         * Sharpness continuation -> solve with the model's sharpness constants (Model::sharpness) scaled by every
+         * factor in turn, each stage warm-started from the optimum of the previous one. A final stage at factor 1
+         * is added if missing. p_const is a dynamical parameter of the tape, so increasing factors reuse the tape
+         * recorded at the first (smoothest) stage. The result is the one of the last stage, the iteration count and
+         * the telemetry (get_stats) the sum over the stages.
+         */
+        void solve_continuation() {
+            Plant &_plant = *plant;
+            std::vector<int> _indices = _plant._model->sharpness();
+            if (_indices.empty()) {
+                throw std::invalid_argument("Model '" + _plant._model->name() + "' has no sharpness constants");
+            };
+            _plant.check_model();
+            std::vector<double> _factors = _continuation;
+            if (_factors.back() != 1.) { _factors.push_back(1.); };
+            vector<double> _p_const = _plant._p_const;
+            vector<double> _p_opt = _plant._p_opt;
+            _stages.clear();
+            int _iterations = 0;
+            Telemetry _telemetry; // Every stage resets the plant's telemetry
+            try {
+                for(double f : _factors) {
+                    vector<double> _scaled = _p_const;
+                    for(int i : _indices) { _scaled(i) *= f; };
+                    _plant.set_p_const(_scaled);
+                    solve_plant(plant, _print_level, lbfgsb);
+                    _stages.push_back(ContinuationStage{f, _plant._iterations, _plant._objective, _plant._status_solve});
+                    _iterations += _plant._iterations;
+                    _telemetry.add(_plant._telemetry);
+                    _plant._p_opt = _plant._p_opt_ipopt; // Warm start of the next stage
+                };
+            } catch (...) {
+                _telemetry.add(_plant._telemetry);
+                _plant._telemetry.reset();
+                _plant._telemetry.add(_telemetry);
+                _plant.set_p_const(_p_const);
+                _plant._p_opt = _p_opt;
+                throw;
+            };
+            _plant.set_p_const(_p_const);
+            _plant._p_opt = _p_opt;
+            _plant._iterations = _iterations;
+            _plant._telemetry.reset();
+            _plant._telemetry.add(_telemetry);
+        };
+        // Solve a single plant with the selected backend -> also used by the drivers built on NLP
+        void solve_plant(const SmartPtr<Plant> &_plant, int print_level) const {
+            LBFGSB _lbfgsb = lbfgsb; // Foreign plants may be solved concurrently -> private copy of the settings
+            solve_plant(_plant, print_level, _lbfgsb);
+        };
+        // Same, with the L-BFGS-B outputs (iterations, evaluations, objective) left in solver
+        void solve_plant(const SmartPtr<Plant> &_plant, int print_level, LBFGSB &solver) const {
+            (*_plant).check_model();
+            TRACE_SCOPE("solve", "solve");
+            STATS_TIMER((*_plant)._telemetry, solve_seconds);
+            if (_solver == "lbfgsb") {
+                (*_plant).solve_lbfgsb(solver);
+                return;
+            };
             // Define IPOPT application
-            SmartPtr<IpoptApplication> app = IpoptApplicationFactory();
-            // Set options
-            std::string tag = "tol";
-            std::string val = "";
-            app->Options()->SetNumericValue(tag, 1e-4);
-            tag = "hessian_approximation";
-            val = "limited-memory";
-            app->Options()->SetStringValue(tag, val);
-            tag = "print_level";
-            app->Options()->SetIntegerValue(tag, 5);
+            SmartPtr<IpoptApplication> app = ipopt_application(print_level);
             // Initialize IPOPT application
-            (*plant)._status_init = (int) app->Initialize();
+            (*_plant)._status_init = (int) app->Initialize();
+            (*_plant).start_progress();
+            SmartPtr<MemoryJournal> journal;
+            if (_journal_level > 0) {
+                journal = new MemoryJournal("memory", (EJournalLevel) _journal_level);
+                app->Jnlst()->AddJournal(GetRawPtr(journal));
+            };
             // Solve NLP
-            (*plant)._status_solve = (int) app->OptimizeTNLP(plant);
+            (*_plant)._status_solve = (int) app->OptimizeTNLP(_plant);
+            if (IsValid(journal)) { (*_plant)._journal = journal->buffer; };
         };
     };
 }
@@ -0,0 +1,110 @@
+#ifndef SWITCHINGTIMES_TELEMETRY_HPP
+#define SWITCHINGTIMES_TELEMETRY_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Solve telemetry is compiled in unless SWITCHINGTIMES_STATS is defined as 0 -> the macros below then expand to
+ * nothing and the stats of a solve stay zero
+ */
+#ifndef SWITCHINGTIMES_STATS
+#define SWITCHINGTIMES_STATS 1
+#endif
+
+#if SWITCHINGTIMES_STATS
+#define STATS_ONLY(statement) statement
+#define STATS_ADD(telemetry, counter, n) (telemetry).add(Telemetry::counter, n)
+#define STATS_TIMER(telemetry, timer) ScopedTimer _stats_timer_##timer((telemetry), Telemetry::timer)
+#else
+#define STATS_ONLY(statement)
+#define STATS_ADD(telemetry, counter, n) ((void) 0)
+#define STATS_TIMER(telemetry, timer) ((void) 0)
+#endif
+
+namespace SwitchingTimes {
+    /*
+     * Counters and accumulated phase times of the last solve (snapshot returned to Python)
+     */
+    struct SolveStats {
+        uint64_t rhs_evaluations = 0;    // Model right-hand-side evaluations (double and AD)
+        uint64_t integration_steps = 0;  // ODE solver steps
+        uint64_t tape_recordings = 0;
+        uint64_t new_dynamic_calls = 0;
+        uint64_t eval_f_calls = 0;
+        uint64_t eval_grad_f_calls = 0;
+        uint64_t eval_g_calls = 0;
+        uint64_t eval_jac_g_calls = 0;
+        uint64_t eval_h_calls = 0;
+        size_t tape_size_var = 0;        // Size of the current objective tape
+        size_t tape_size_op = 0;
+        int iterations = 0;              // Solver iterations
+        double objective = 0.;           // Objective at the returned solution
+        double tape_seconds = 0.;        // Recording
+        double eval_f_seconds = 0.;
+        double eval_grad_f_seconds = 0.;
+        double solve_seconds = 0.;       // Wall time of the solve
+    };
+    /*
+     * Thread-safe accumulation -> integrations count locally and add once, so the atomics are not contended
+     */
+    class Telemetry {
+    public:
+        enum Counter {
+            rhs_evaluations, integration_steps, tape_recordings, new_dynamic_calls,
+            eval_f_calls, eval_grad_f_calls, eval_g_calls, eval_jac_g_calls, eval_h_calls, n_counters
+        };
+        enum Timer { tape_seconds, eval_f_seconds, eval_grad_f_seconds, solve_seconds, n_timers };
+        std::atomic<uint64_t> counters[n_counters];
+        std::atomic<uint64_t> nanoseconds[n_timers];
+
+        Telemetry() { reset(); };
+        void reset() {
+            for(auto &_counter : counters) { _counter.store(0, std::memory_order_relaxed); };
+            for(auto &_timer : nanoseconds) { _timer.store(0, std::memory_order_relaxed); };
+        };
+        void add(const Counter counter, const uint64_t n) { counters[counter].fetch_add(n, std::memory_order_relaxed); };
+        // Accumulate another telemetry (e.g. the stages of a continuation solve)
+        void add(const Telemetry &other) {
+            for(int k = 0; k < n_counters; ++k) { add((Counter) k, other.count((Counter) k)); };
+            for(int k = 0; k < n_timers; ++k) { add_time((Timer) k, other.nanoseconds[k].load(std::memory_order_relaxed)); };
+        };
+        void add_time(const Timer timer, const uint64_t ns) { nanoseconds[timer].fetch_add(ns, std::memory_order_relaxed); };
+        uint64_t count(const Counter counter) const { return counters[counter].load(std::memory_order_relaxed); };
+        double seconds(const Timer timer) const { return 1e-9 * nanoseconds[timer].load(std::memory_order_relaxed); };
+        SolveStats snapshot() const {
+            SolveStats _out;
+            _out.rhs_evaluations = count(rhs_evaluations);
+            _out.integration_steps = count(integration_steps);
+            _out.tape_recordings = count(tape_recordings);
+            _out.new_dynamic_calls = count(new_dynamic_calls);
+            _out.eval_f_calls = count(eval_f_calls);
+            _out.eval_grad_f_calls = count(eval_grad_f_calls);
+            _out.eval_g_calls = count(eval_g_calls);
+            _out.eval_jac_g_calls = count(eval_jac_g_calls);
+            _out.eval_h_calls = count(eval_h_calls);
+            _out.tape_seconds = seconds(tape_seconds);
+            _out.eval_f_seconds = seconds(eval_f_seconds);
+            _out.eval_grad_f_seconds = seconds(eval_grad_f_seconds);
+            _out.solve_seconds = seconds(solve_seconds);
+            return _out;
+        };
+    };
+    class ScopedTimer {
+    public:
+        ScopedTimer(Telemetry &telemetry, const Telemetry::Timer timer) :
+                _telemetry(telemetry), _timer(timer), _start(std::chrono::steady_clock::now()) {};
+        ~ScopedTimer() {
+            auto _elapsed = std::chrono::steady_clock::now() - _start;
+            _telemetry.add_time(_timer, std::chrono::duration_cast<std::chrono::nanoseconds>(_elapsed).count());
+        };
+    private:
+        Telemetry &_telemetry;
+        Telemetry::Timer _timer;
+        std::chrono::steady_clock::time_point _start;
+    };
+}
+
+#endif //SWITCHINGTIMES_TELEMETRY_HPP
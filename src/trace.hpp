@@ -0,0 +1,158 @@
+#ifndef SWITCHINGTIMES_TRACE_HPP
+#define SWITCHINGTIMES_TRACE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/*
+ * Event tracing is compiled in unless SWITCHINGTIMES_TRACE is defined as 0 and recorded only while started at
+ * runtime (Tracer::start) -> a disabled scope costs one relaxed atomic load
+ */
+#ifndef SWITCHINGTIMES_TRACE
+#define SWITCHINGTIMES_TRACE 1
+#endif
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#if SWITCHINGTIMES_TRACE
+#define TRACE_SCOPE(name, category) TraceScope TRACE_CONCAT(_trace_scope_, __LINE__)((name), (category))
+#define TRACE_CALLBACK(name, mark) TraceScope TRACE_CONCAT(_trace_scope_, __LINE__)((name), "callback", &(mark))
+#define TRACE_INSTANT(name, category, arg_name, arg) Tracer::instance().instant((name), (category), (arg_name), (arg))
+#define TRACE_MARK(mark) ((mark) = Tracer::now())
+#else
+#define TRACE_SCOPE(name, category) ((void) 0)
+#define TRACE_CALLBACK(name, mark) ((void) 0)
+#define TRACE_INSTANT(name, category, arg_name, arg) ((void) 0)
+#define TRACE_MARK(mark) ((void) 0)
+#endif
+
+namespace SwitchingTimes {
+    /*
+     * Chrome trace (chrome://tracing, Perfetto) recorder
+     *
+     * Every thread appends to its own buffer -> recording takes no lock. Buffers are registered once per thread
+     * and owned by the tracer, so events of finished worker threads are kept. Names and categories must be string
+     * literals. dump/json/clear must not run concurrently with traced code (call them between solves).
+     */
+    class Tracer {
+    public:
+        struct Event {
+            const char *name;
+            const char *category;
+            char phase;           // 'X' complete, 'i' instant
+            int64_t start;        // ns since the tracer epoch
+            int64_t duration;     // ns
+            const char *arg_name; // Optional integer argument (NULL if none)
+            int64_t arg;
+        };
+        struct Buffer {
+            size_t tid;
+            std::vector<Event> events;
+        };
+
+        static Tracer &instance() {
+            static Tracer _tracer;
+            return _tracer;
+        };
+        static int64_t now() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - epoch()).count();
+        };
+        bool enabled() const { return _enabled.load(std::memory_order_relaxed); };
+        void start() { _enabled = true; };
+        void stop() { _enabled = false; };
+        void clear() {
+            std::lock_guard<std::mutex> _lock(_mutex);
+            for(auto &_buffer : _buffers) { _buffer->events.clear(); };
+        };
+        void complete(const char *name, const char *category, const int64_t start, const int64_t end,
+                      const char *arg_name = NULL, const int64_t arg = 0) {
+            buffer().events.push_back(Event{name, category, 'X', start, end - start, arg_name, arg});
+        };
+        void instant(const char *name, const char *category, const char *arg_name, const int64_t arg) {
+            if (!enabled()) { return; };
+            buffer().events.push_back(Event{name, category, 'i', now(), 0, arg_name, arg});
+        };
+        // Chrome trace JSON -> timestamps in microseconds
+        std::string json() {
+            std::lock_guard<std::mutex> _lock(_mutex);
+            std::ostringstream _out;
+            _out.precision(3);
+            _out << std::fixed << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+            bool _first = true;
+            for(const auto &_buffer : _buffers) {
+                _out << (_first ? "\n" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": "
+                     << _buffer->tid << ", \"args\": {\"name\": \"thread " << _buffer->tid << "\"}}";
+                _first = false;
+                for(const Event &e : _buffer->events) {
+                    _out << ",\n{\"name\": \"" << e.name << "\", \"cat\": \"" << e.category << "\", \"ph\": \""
+                         << e.phase << "\", \"ts\": " << 1e-3 * e.start << ", \"pid\": 1, \"tid\": " << _buffer->tid;
+                    if (e.phase == 'X') { _out << ", \"dur\": " << 1e-3 * e.duration; } else { _out << ", \"s\": \"t\""; };
+                    if (e.arg_name != NULL) { _out << ", \"args\": {\"" << e.arg_name << "\": " << e.arg << "}"; };
+                    _out << "}";
+                };
+            };
+            _out << "\n]}\n";
+            return _out.str();
+        };
+        void dump(const std::string &path) {
+            std::ofstream _file(path);
+            if (!_file) { throw std::runtime_error("Cannot open trace file '" + path + "'"); };
+            _file << json();
+        };
+
+    private:
+        std::atomic<bool> _enabled{false};
+        std::mutex _mutex;
+        std::vector<std::unique_ptr<Buffer>> _buffers;
+
+        static std::chrono::steady_clock::time_point epoch() {
+            static const std::chrono::steady_clock::time_point _epoch = std::chrono::steady_clock::now();
+            return _epoch;
+        };
+        Buffer &buffer() {
+            thread_local Buffer *_buffer = nullptr;
+            if (_buffer == nullptr) {
+                std::lock_guard<std::mutex> _lock(_mutex);
+                _buffers.emplace_back(new Buffer{_buffers.size(), {}});
+                _buffer = _buffers.back().get();
+                _buffer->events.reserve(1 << 14);
+            };
+            return *_buffer;
+        };
+    };
+    /*
+     * Scoped complete event. With a mark, the time since the mark (the end of the previous callback of the same
+     * solve) is recorded as "solver" -> the time the solver spends between our callbacks, e.g. in its linear solver.
+     */
+    class TraceScope {
+    public:
+        TraceScope(const char *name, const char *category, int64_t *mark = nullptr) :
+                _name(name), _category(category), _mark(mark), _start(-1) {
+            if (!Tracer::instance().enabled()) { return; };
+            _start = Tracer::now();
+            if (_mark != nullptr && *_mark > 0) { Tracer::instance().complete("solver", "solver", *_mark, _start); };
+        };
+        ~TraceScope() {
+            if (_start < 0) { return; };
+            int64_t _end = Tracer::now();
+            Tracer::instance().complete(_name, _category, _start, _end);
+            if (_mark != nullptr) { *_mark = _end; };
+        };
+    private:
+        const char *_name;
+        const char *_category;
+        int64_t *_mark;
+        int64_t _start; // -1 if not recording
+    };
+}
+
+#endif //SWITCHINGTIMES_TRACE_HPP